@@ -29,6 +29,25 @@ void* array_hold(void* array, int count, int item_size) {
     }
 }
 
+// Make room for count more items without changing the length, so pushing them never reallocates
+void* array_reserve(void* array, int count, int item_size) {
+    if (array == NULL) {
+        int raw_size = (sizeof(int) * 2) + (item_size * count);
+        int* base = (int*)malloc(raw_size);
+        base[0] = count;  // capacity
+        base[1] = 0;      // occupied
+        return base + 2;
+    } else if (ARRAY_OCCUPIED(array) + count <= ARRAY_CAPACITY(array)) {
+        return array;
+    } else {
+        int capacity = ARRAY_OCCUPIED(array) + count;
+        int raw_size = sizeof(int) * 2 + item_size * capacity;
+        int* base = (int*)realloc(ARRAY_RAW_DATA(array), raw_size);
+        base[0] = capacity;
+        return base + 2;
+    }
+}
+
 int array_length(void* array) {
     return (array != NULL) ? ARRAY_OCCUPIED(array) : 0;
 }
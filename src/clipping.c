@@ -2,9 +2,12 @@
 
 #include <math.h>
 
-#define NUM_PLANES 6
 plane_t frustum_planes[NUM_PLANES];
 
+// Size of the guard band in clip space, as a multiple of w
+static float guard_band_x = 1;
+static float guard_band_y = 1;
+
 void init_frustum_planes(float fov_x, float fov_y, float z_near, float z_far) {
     float cos_half_fov_x = cos(fov_x / 2);
 	float sin_half_fov_x = sin(fov_x / 2);
@@ -43,11 +46,67 @@ void init_frustum_planes(float fov_x, float fov_y, float z_near, float z_far) {
 	frustum_planes[FAR_FRUSTUM_PLANE].normal.z = -1;
 }
 
-polygon_t create_polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2) {
+// The guard band reaches GUARD_BAND_LIMIT_PIXELS from the center of the screen in every direction
+void init_guard_band(int screen_width, int screen_height) {
+	guard_band_x = (GUARD_BAND_LIMIT_PIXELS - screen_width / 2.0) / (screen_width / 2.0);
+	guard_band_y = (GUARD_BAND_LIMIT_PIXELS - screen_height / 2.0) / (screen_height / 2.0);
+}
+
+// True when the sphere lies fully outside one of the frustum planes
+bool is_sphere_outside_frustum(vec3_t center, float radius) {
+	for (int p = 0; p < NUM_PLANES; p++) {
+		if (vec3_dot(vec3_sub(center, frustum_planes[p].point), frustum_planes[p].normal) < -radius) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Find which frustum and guard band planes a clip-space vertex is outside of
+uint16_t clip_space_outcode(vec4_t v) {
+	uint16_t outcode = 0;
+	if (v.x < -v.w) outcode |= OUTCODE_LEFT;
+	if (v.x > v.w) outcode |= OUTCODE_RIGHT;
+	if (v.y > v.w) outcode |= OUTCODE_TOP;
+	if (v.y < -v.w) outcode |= OUTCODE_BOTTOM;
+	if (v.z < 0) outcode |= OUTCODE_NEAR;
+	if (v.z > v.w) outcode |= OUTCODE_FAR;
+	if (v.x < -guard_band_x * v.w) outcode |= OUTCODE_GUARD_LEFT;
+	if (v.x > guard_band_x * v.w) outcode |= OUTCODE_GUARD_RIGHT;
+	if (v.y > guard_band_y * v.w) outcode |= OUTCODE_GUARD_TOP;
+	if (v.y < -guard_band_y * v.w) outcode |= OUTCODE_GUARD_BOTTOM;
+	return outcode;
+}
+
+// Pick the planes a triangle has to be clipped against from the union of its vertex outcodes.
+// With the guard band, crossing a side plane is left to the rasterizer's scissor and only the
+// near and far planes, or a side whose guard band is crossed too, need geometric clipping.
+uint16_t planes_to_clip(uint16_t outcode_union, bool use_guard_band) {
+	if (!use_guard_band) {
+		return outcode_union & OUTCODE_FRUSTUM;
+	}
+	uint16_t guard_band_overflow = (outcode_union >> OUTCODE_GUARD_SHIFT) & OUTCODE_SIDES;
+	return (outcode_union & (OUTCODE_NEAR | OUTCODE_FAR)) | guard_band_overflow;
+}
+
+// Project camera-space vertices to homogeneous clip space and compute their outcodes
+void transform_to_clip_space(const mat4_t* proj_matrix, const vertex_stream_t* vertices, vec4_t* clip_vertices, uint16_t* outcodes) {
+	for (int i = 0; i < vertices->count; i++) {
+		clip_vertices[i] = mat4_mul_vec4(*proj_matrix, vec4_from_vec3(vertex_stream_get(vertices, i)));
+		outcodes[i] = clip_space_outcode(clip_vertices[i]);
+	}
+}
+
+polygon_t create_polygon_from_triangle(vec4_t v0, vec4_t v1, vec4_t v2, float attributes[3][NUM_VERTEX_ATTRIBUTES]) {
 	polygon_t polygon = {
 		.vertices = { v0, v1, v2 },
 		.num_vertices = 3
 	};
+	for (int i = 0; i < 3; i++) {
+		for (int k = 0; k < NUM_VERTEX_ATTRIBUTES; k++) {
+			polygon.attributes[i][k] = attributes[i][k];
+		}
+	}
 	return polygon;
 }
 
@@ -57,73 +116,108 @@ void triangles_from_polygon(polygon_t* polygon, triangle_t triangles[], int* num
 		int index1 = i +1;
 		int index2 = i +2;
 
-		triangles[i].points[0] = vec4_from_vec3(polygon->vertices[index0]); 
-		triangles[i].points[1] = vec4_from_vec3(polygon->vertices[index1]); 
-		triangles[i].points[2] = vec4_from_vec3(polygon->vertices[index2]);
+		triangles[i].points[0] = polygon->vertices[index0];
+		triangles[i].points[1] = polygon->vertices[index1];
+		triangles[i].points[2] = polygon->vertices[index2];
+
+		triangles[i].texcoords[0].u = polygon->attributes[index0][ATTRIBUTE_U];
+		triangles[i].texcoords[0].v = polygon->attributes[index0][ATTRIBUTE_V];
+		triangles[i].texcoords[1].u = polygon->attributes[index1][ATTRIBUTE_U];
+		triangles[i].texcoords[1].v = polygon->attributes[index1][ATTRIBUTE_V];
+		triangles[i].texcoords[2].u = polygon->attributes[index2][ATTRIBUTE_U];
+		triangles[i].texcoords[2].v = polygon->attributes[index2][ATTRIBUTE_V];
 	}
 	*num_triangles = polygon->num_vertices - 2;
 }
 
-void clip_polygon_against_plane(polygon_t* polygon, int plane) {
-	vec3_t plane_point = frustum_planes[plane].point;
-	vec3_t plane_normal = frustum_planes[plane].normal;
+// Signed distance of a clip-space vertex to a frustum plane, positive on the inside
+static float plane_distance(vec4_t v, int plane) {
+	switch (plane) {
+	case LEFT_FRUSTUM_PLANE: return v.w + v.x;
+	case RIGHT_FRUSTUM_PLANE: return v.w - v.x;
+	case TOP_FRUSTUM_PLANE: return v.w - v.y;
+	case BOTTOM_FRUSTUM_PLANE: return v.w + v.y;
+	case NEAR_FRUSTUM_PLANE: return v.z;
+	default: return v.w - v.z;
+	}
+}
+
+static vec4_t vec4_lerp(vec4_t a, vec4_t b, float t) {
+	vec4_t result = {
+		a.x + t * (b.x - a.x),
+		a.y + t * (b.y - a.y),
+		a.z + t * (b.z - a.z),
+		a.w + t * (b.w - a.w)
+	};
+	return result;
+}
 
+void clip_polygon_against_plane(polygon_t* polygon, int plane) {
 	// Declare a static array of inside vertices that will be part of the final polygon
-	vec3_t inside_vertices[MAX_NUM_POLY_VERTICES];
+	vec4_t inside_vertices[MAX_NUM_POLY_VERTICES];
+	float inside_attributes[MAX_NUM_POLY_VERTICES][NUM_VERTEX_ATTRIBUTES];
 	int num_inside_vertices = 0;
 
 	// Start current vertex with the first polygon vertex, and the previous with the last polygon vertex
-	vec3_t* current_vertex = &polygon->vertices[0];
-	vec3_t* previous_vertex = &polygon->vertices[polygon->num_vertices - 1];
+	vec4_t* current_vertex = &polygon->vertices[0];
+	vec4_t* previous_vertex = &polygon->vertices[polygon->num_vertices - 1];
+	float* current_attributes = polygon->attributes[0];
+	float* previous_attributes = polygon->attributes[polygon->num_vertices - 1];
 
-	// Calculate dot product of the current and previous vertex
+	// Calculate the distance of the current and previous vertex to the plane
 	float current_dot = 0;
-	float previous_dot = vec3_dot(vec3_sub(*previous_vertex, plane_point), plane_normal);
+	float previous_dot = plane_distance(*previous_vertex, plane);
 
 	// Loop all the polygon vertices while the current is different than the last one
 	while (current_vertex != &polygon->vertices[polygon->num_vertices])
 	{
-		current_dot = vec3_dot(vec3_sub(*current_vertex, plane_point), plane_normal);
+		current_dot = plane_distance(*current_vertex, plane);
 
 		// If we changed from inside to outsuide or outside to inside
 		if (current_dot * previous_dot < 0) {
 			// Find the interpolation factor
 			float t = previous_dot / (previous_dot - current_dot);
-			// Find intersection point using the interpolation factor
-			vec3_t intersection_point = vec3_clone(current_vertex);					// I = Qc
-			intersection_point = vec3_sub(intersection_point, *previous_vertex);	// I = (Qc - Qp)
-			intersection_point = vec3_mul(intersection_point, t);					// I = t(Qc - Qp)
-			intersection_point = vec3_add(intersection_point, *previous_vertex);	// I = Qp + t(Qc - Qp)
-
-			// Add intersection point to the list of inside vertices
-			inside_vertices[num_inside_vertices] = vec3_clone(&intersection_point);
+
+			// Add the intersection point I = Qp + t(Qc - Qp) to the list of inside vertices, with its attributes interpolated the same way
+			inside_vertices[num_inside_vertices] = vec4_lerp(*previous_vertex, *current_vertex, t);
+			for (int k = 0; k < NUM_VERTEX_ATTRIBUTES; k++) {
+				inside_attributes[num_inside_vertices][k] = previous_attributes[k] + t * (current_attributes[k] - previous_attributes[k]);
+			}
 			num_inside_vertices++;
 		}
 
 		// Current vertex is inside the plane
 		if (current_dot > 0) {
 			// Add current vertex to the list of inside vertices
-			inside_vertices[num_inside_vertices] = vec3_clone(current_vertex);
+			inside_vertices[num_inside_vertices] = *current_vertex;
+			for (int k = 0; k < NUM_VERTEX_ATTRIBUTES; k++) {
+				inside_attributes[num_inside_vertices][k] = current_attributes[k];
+			}
 			num_inside_vertices++;
 		}
 
 		// Move to the next vertex
 		previous_dot = current_dot;
 		previous_vertex = current_vertex;
+		previous_attributes = current_attributes;
 		current_vertex++;
+		current_attributes += NUM_VERTEX_ATTRIBUTES;
 	}
 	// Copy the list of inside vertices into the destination polygon
 	for (int i = 0; i < num_inside_vertices; i++) {
-		polygon->vertices[i] = vec3_clone(&inside_vertices[i]);
+		polygon->vertices[i] = inside_vertices[i];
+		for (int k = 0; k < NUM_VERTEX_ATTRIBUTES; k++) {
+			polygon->attributes[i][k] = inside_attributes[i][k];
+		}
 	}
 	polygon->num_vertices = num_inside_vertices;
 }
 
-void clip_polygon(polygon_t* polygon) {
-	clip_polygon_against_plane(polygon, LEFT_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, RIGHT_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, TOP_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, BOTTOM_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, NEAR_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, FAR_FRUSTUM_PLANE);
+// Clip the polygon against the frustum planes set in the outcode mask, the rest are known to be inside
+void clip_polygon(polygon_t* polygon, uint16_t planes) {
+	for (int plane = 0; plane < NUM_PLANES; plane++) {
+		if (planes & (1 << plane)) {
+			clip_polygon_against_plane(polygon, plane);
+		}
+	}
 }
\ No newline at end of file
@@ -1,19 +1,51 @@
 #ifndef CLIPPING_H
 #define CLIPPING_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "vector.h"
+#include "matrix.h"
+#include "vertex_stream.h"
 #include "triangle.h"
 
 #define MAX_NUM_POLY_VERTICES 10
 #define MAX_NUM_POLY_TRIANGLES 10
 
+// Largest screen coordinate the guard band lets through, small enough that the rasterizer's
+// integer edge functions cannot overflow
+#define GUARD_BAND_LIMIT_PIXELS 8192
+
 enum {
     LEFT_FRUSTUM_PLANE,
     RIGHT_FRUSTUM_PLANE,
     TOP_FRUSTUM_PLANE,
     BOTTOM_FRUSTUM_PLANE,
     NEAR_FRUSTUM_PLANE,
-    FAR_FRUSTUM_PLANE
+    FAR_FRUSTUM_PLANE,
+    NUM_PLANES
+};
+
+///////////////////////////////////////////////////////////////
+// Outcode bits of a clip-space vertex, one per frustum plane //
+// the vertex is outside of: -w <= x, y <= w and 0 <= z <= w  //
+// The guard band bits repeat the side planes pushed out to   //
+// GUARD_BAND_LIMIT_PIXELS, shifted up by OUTCODE_GUARD_SHIFT //
+///////////////////////////////////////////////////////////////
+#define OUTCODE_GUARD_SHIFT 6
+
+enum {
+    OUTCODE_LEFT = 1 << LEFT_FRUSTUM_PLANE,
+    OUTCODE_RIGHT = 1 << RIGHT_FRUSTUM_PLANE,
+    OUTCODE_TOP = 1 << TOP_FRUSTUM_PLANE,
+    OUTCODE_BOTTOM = 1 << BOTTOM_FRUSTUM_PLANE,
+    OUTCODE_NEAR = 1 << NEAR_FRUSTUM_PLANE,
+    OUTCODE_FAR = 1 << FAR_FRUSTUM_PLANE,
+    OUTCODE_FRUSTUM = (1 << OUTCODE_GUARD_SHIFT) - 1,
+    OUTCODE_SIDES = OUTCODE_LEFT | OUTCODE_RIGHT | OUTCODE_TOP | OUTCODE_BOTTOM,
+    OUTCODE_GUARD_LEFT = OUTCODE_LEFT << OUTCODE_GUARD_SHIFT,
+    OUTCODE_GUARD_RIGHT = OUTCODE_RIGHT << OUTCODE_GUARD_SHIFT,
+    OUTCODE_GUARD_TOP = OUTCODE_TOP << OUTCODE_GUARD_SHIFT,
+    OUTCODE_GUARD_BOTTOM = OUTCODE_BOTTOM << OUTCODE_GUARD_SHIFT
 };
 
 typedef struct {
@@ -21,14 +53,33 @@ typedef struct {
     vec3_t normal;
 } plane_t;
 
+extern plane_t frustum_planes[NUM_PLANES];   // camera space, the normals point into the frustum
+
+////////////////////////////////////////////////////////////////
+// Attributes carried by every polygon vertex and interpolated //
+// along with its position. The count is fixed at compile time //
+// so the interpolation loop in the clipper stays tight.       //
+////////////////////////////////////////////////////////////////
+enum {
+    ATTRIBUTE_U,
+    ATTRIBUTE_V,
+    NUM_VERTEX_ATTRIBUTES
+};
+
 typedef struct {
-    vec3_t vertices[MAX_NUM_POLY_VERTICES];
+    vec4_t vertices[MAX_NUM_POLY_VERTICES];     // clip-space positions
+    float attributes[MAX_NUM_POLY_VERTICES][NUM_VERTEX_ATTRIBUTES];
     int num_vertices;
 } polygon_t;
 
 void init_frustum_planes(float fov_x, float fov_y, float z_near, float z_far);
-polygon_t create_polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2);
+void init_guard_band(int screen_width, int screen_height);
+bool is_sphere_outside_frustum(vec3_t center, float radius);   // center in camera space
+uint16_t clip_space_outcode(vec4_t v);
+uint16_t planes_to_clip(uint16_t outcode_union, bool use_guard_band);
+void transform_to_clip_space(const mat4_t* proj_matrix, const vertex_stream_t* vertices, vec4_t* clip_vertices, uint16_t* outcodes);
+polygon_t create_polygon_from_triangle(vec4_t v0, vec4_t v1, vec4_t v2, float attributes[3][NUM_VERTEX_ATTRIBUTES]);
 void triangles_from_polygon(polygon_t* polygon, triangle_t triangles[], int* num_triangles);
-void clip_polygon(polygon_t* polygon);
+void clip_polygon(polygon_t* polygon, uint16_t planes);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include <math.h>
+#include "cluster.h"
+#include "clipping.h"
+#include "array.h"
+
+static vec3_t face_normal(const vec3_t* vertices, const face_t* face) {
+    vec3_t a = vertices[face->a];
+    return vec3_cross(vec3_sub(vertices[face->b], a), vec3_sub(vertices[face->c], a));
+}
+
+// Bounding sphere and normal cone of the faces of a cluster
+static void compute_cluster_bounds(cluster_t* cluster, const vec3_t* vertices, const face_t* faces) {
+    const face_t* first = &faces[cluster->first_face];
+
+    // Sphere around the center of the bounding box, good enough for runs of nearby faces
+    vec3_t min = vertices[first->a];
+    vec3_t max = min;
+    for (int i = 0; i < cluster->num_faces; i++) {
+        int indices[3] = { first[i].a, first[i].b, first[i].c };
+        for (int k = 0; k < 3; k++) {
+            vec3_t v = vertices[indices[k]];
+            min = vec3_new(fminf(min.x, v.x), fminf(min.y, v.y), fminf(min.z, v.z));
+            max = vec3_new(fmaxf(max.x, v.x), fmaxf(max.y, v.y), fmaxf(max.z, v.z));
+        }
+    }
+    cluster->center = vec3_mul(vec3_add(min, max), 0.5);
+    cluster->radius = 0;
+    for (int i = 0; i < cluster->num_faces; i++) {
+        int indices[3] = { first[i].a, first[i].b, first[i].c };
+        for (int k = 0; k < 3; k++) {
+            float distance = vec3_length(vec3_sub(vertices[indices[k]], cluster->center));
+            cluster->radius = fmaxf(cluster->radius, distance);
+        }
+    }
+
+    // The cone axis averages the unit normals, the cone is as wide as the normal furthest from it
+    vec3_t axis = vec3_new(0, 0, 0);
+    for (int i = 0; i < cluster->num_faces; i++) {
+        vec3_t normal = face_normal(vertices, &first[i]);
+        if (vec3_length(normal) == 0) continue;
+        vec3_normalize(&normal);
+        axis = vec3_add(axis, normal);
+    }
+    cluster->cone_axis = vec3_new(0, 0, 0);
+    cluster->cone_sin = 1;
+    if (vec3_length(axis) == 0) return;
+    vec3_normalize(&axis);
+
+    float min_cos = 1;
+    for (int i = 0; i < cluster->num_faces; i++) {
+        vec3_t normal = face_normal(vertices, &first[i]);
+        if (vec3_length(normal) == 0) continue;
+        vec3_normalize(&normal);
+        min_cos = fminf(min_cos, vec3_dot(normal, axis));
+    }
+    // Normals 90 degrees or more apart can never all face away at once
+    if (min_cos <= 0) return;
+    cluster->cone_axis = axis;
+    cluster->cone_sin = sqrtf(1 - min_cos * min_cos);
+}
+
+// Split the faces into runs of consecutive faces. Faces are in vertex cache order, so runs stay
+// compact, and a run closes early when a face bends too far from its average normal.
+cluster_t* build_clusters(const vec3_t* vertices, const face_t* faces, int num_faces) {
+    cluster_t* clusters = NULL;
+    cluster_t cluster = { .first_face = 0, .num_faces = 0 };
+    vec3_t normal_sum = vec3_new(0, 0, 0);
+
+    for (int i = 0; i < num_faces; i++) {
+        vec3_t normal = face_normal(vertices, &faces[i]);
+        if (vec3_length(normal) > 0) vec3_normalize(&normal);
+
+        bool is_full = cluster.num_faces >= MAX_CLUSTER_FACES;
+        if (!is_full && cluster.num_faces >= MIN_CLUSTER_FACES && vec3_length(normal_sum) > 0) {
+            vec3_t average = normal_sum;
+            vec3_normalize(&average);
+            is_full = vec3_dot(normal, average) < CLUSTER_NORMAL_SPLIT;
+        }
+        if (is_full) {
+            compute_cluster_bounds(&cluster, vertices, faces);
+            array_push(clusters, cluster);
+            cluster.first_face = i;
+            cluster.num_faces = 0;
+            normal_sum = vec3_new(0, 0, 0);
+        }
+        cluster.num_faces++;
+        normal_sum = vec3_add(normal_sum, normal);
+    }
+    if (cluster.num_faces > 0) {
+        compute_cluster_bounds(&cluster, vertices, faces);
+        array_push(clusters, cluster);
+    }
+    return clusters;
+}
+
+// Position of the camera in model space, false when the matrix mirrors or flattens the mesh
+static bool camera_position_in_model_space(const mat4_t* m, vec3_t* position) {
+    const float (*a)[4] = m->m;
+    float c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+    float c01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+    float c02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+    float det = a[0][0] * c00 + a[0][1] * c01 + a[0][2] * c02;
+    if (!(det > 0)) return false;
+
+    // Solve A x = -t with the inverse of the upper 3x3 block, the camera sits at the origin of camera space
+    float inverse[3][3] = {
+        { c00, a[0][2] * a[2][1] - a[0][1] * a[2][2], a[0][1] * a[1][2] - a[0][2] * a[1][1] },
+        { c01, a[0][0] * a[2][2] - a[0][2] * a[2][0], a[0][2] * a[1][0] - a[0][0] * a[1][2] },
+        { c02, a[0][1] * a[2][0] - a[0][0] * a[2][1], a[0][0] * a[1][1] - a[0][1] * a[1][0] }
+    };
+    float t[3] = { -a[0][3], -a[1][3], -a[2][3] };
+    position->x = (inverse[0][0] * t[0] + inverse[0][1] * t[1] + inverse[0][2] * t[2]) / det;
+    position->y = (inverse[1][0] * t[0] + inverse[1][1] * t[1] + inverse[1][2] * t[2]) / det;
+    position->z = (inverse[2][0] * t[0] + inverse[2][1] * t[1] + inverse[2][2] * t[2]) / det;
+    return true;
+}
+
+// Write the indices of the clusters that may have visible faces, and return how many there are
+int cull_clusters(const cluster_t* clusters, int num_clusters, const mat4_t* model_view_matrix, bool cull_backfacing, int* visible_clusters) {
+    const float (*a)[4] = model_view_matrix->m;
+
+    // The sphere grows with the largest scale the matrix applies along any axis
+    float scale = mat4_max_scale(model_view_matrix);
+
+    // Backfacing is tested in model space, where the cone was built
+    vec3_t camera_position;
+    cull_backfacing = cull_backfacing && camera_position_in_model_space(model_view_matrix, &camera_position);
+
+    int num_visible = 0;
+    for (int i = 0; i < num_clusters; i++) {
+        const cluster_t* cluster = &clusters[i];
+
+        // Every face points away from any point of the sphere when the view direction is
+        // inside the cone mirrored to the far side of the normals
+        if (cull_backfacing) {
+            vec3_t view = vec3_sub(cluster->center, camera_position);
+            float distance = vec3_length(view);
+            if (vec3_dot(view, cluster->cone_axis) > cluster->cone_sin * distance + cluster->radius * (1 + cluster->cone_sin)) {
+                continue;
+            }
+        }
+
+        // Reject the cluster when its sphere lies fully outside one of the camera-space frustum planes
+        vec3_t c = cluster->center;
+        vec3_t center = vec3_new(
+            a[0][0] * c.x + a[0][1] * c.y + a[0][2] * c.z + a[0][3],
+            a[1][0] * c.x + a[1][1] * c.y + a[1][2] * c.z + a[1][3],
+            a[2][0] * c.x + a[2][1] * c.y + a[2][2] * c.z + a[2][3]
+        );
+        if (is_sphere_outside_frustum(center, cluster->radius * scale)) continue;
+
+        visible_clusters[num_visible++] = i;
+    }
+    return num_visible;
+}
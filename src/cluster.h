@@ -0,0 +1,30 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdbool.h>
+#include "vector.h"
+#include "matrix.h"
+#include "triangle.h"
+
+#define MIN_CLUSTER_FACES 64    // a cluster only closes early once it has this many faces
+#define MAX_CLUSTER_FACES 128
+#define CLUSTER_NORMAL_SPLIT 0.5f   // cosine between a face and the cluster normal that closes the cluster early
+
+//////////////////////////////////////////////////////////////////
+// Run of consecutive mesh faces culled as a whole. The sphere   //
+// bounds every vertex of the cluster and the cone every face    //
+// normal, both in model space.                                  //
+//////////////////////////////////////////////////////////////////
+typedef struct {
+    int first_face;     // index of the first face in the mesh face array
+    int num_faces;
+    vec3_t center;
+    float radius;
+    vec3_t cone_axis;   // unit average of the face normals
+    float cone_sin;     // sine of the widest angle between a normal and the axis, 1 when the cone cannot cull
+} cluster_t;
+
+cluster_t* build_clusters(const vec3_t* vertices, const face_t* faces, int num_faces);
+int cull_clusters(const cluster_t* clusters, int num_clusters, const mat4_t* model_view_matrix, bool cull_backfacing, int* visible_clusters);
+
+#endif
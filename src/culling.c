@@ -0,0 +1,122 @@
+#include <stddef.h>
+#include "culling.h"
+#include "simd.h"
+
+//////////////////////////////////////////////////////////////////
+// A face is culled when the camera ray from its vertex A points //
+// against its normal. Only the sign of the dot product matters, //
+// so the edge vectors and the normal are never normalized.      //
+//////////////////////////////////////////////////////////////////
+static int cull_backfaces_scalar(const vertex_stream_t* vertices, const face_t* faces, int first_face, int num_faces, int* visible_faces) {
+    int num_visible = 0;
+    for (int i = first_face; i < num_faces; i++) {
+        vec3_t a = vertex_stream_get(vertices, faces[i].a);
+        vec3_t b = vertex_stream_get(vertices, faces[i].b);
+        vec3_t c = vertex_stream_get(vertices, faces[i].c);
+
+        vec3_t normal = vec3_cross(vec3_sub(b, a), vec3_sub(c, a));
+        vec3_t camera_ray = vec3_sub(vec3_new(0, 0, 0), a);
+
+        if (!(vec3_dot(normal, camera_ray) < 0)) {
+            visible_faces[num_visible++] = i;
+        }
+    }
+    return num_visible;
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET_SSE2
+static int cull_backfaces_sse2(const vertex_stream_t* vertices, const face_t* faces, int num_faces, int* visible_faces) {
+    const float* vx = vertices->x;
+    const float* vy = vertices->y;
+    const float* vz = vertices->z;
+    int num_visible = 0;
+
+    int i = 0;
+    for (; i + 4 <= num_faces; i += 4) {
+        const face_t* f = &faces[i];
+        __m128 ax = _mm_setr_ps(vx[f[0].a], vx[f[1].a], vx[f[2].a], vx[f[3].a]);
+        __m128 ay = _mm_setr_ps(vy[f[0].a], vy[f[1].a], vy[f[2].a], vy[f[3].a]);
+        __m128 az = _mm_setr_ps(vz[f[0].a], vz[f[1].a], vz[f[2].a], vz[f[3].a]);
+        __m128 abx = _mm_sub_ps(_mm_setr_ps(vx[f[0].b], vx[f[1].b], vx[f[2].b], vx[f[3].b]), ax);
+        __m128 aby = _mm_sub_ps(_mm_setr_ps(vy[f[0].b], vy[f[1].b], vy[f[2].b], vy[f[3].b]), ay);
+        __m128 abz = _mm_sub_ps(_mm_setr_ps(vz[f[0].b], vz[f[1].b], vz[f[2].b], vz[f[3].b]), az);
+        __m128 acx = _mm_sub_ps(_mm_setr_ps(vx[f[0].c], vx[f[1].c], vx[f[2].c], vx[f[3].c]), ax);
+        __m128 acy = _mm_sub_ps(_mm_setr_ps(vy[f[0].c], vy[f[1].c], vy[f[2].c], vy[f[3].c]), ay);
+        __m128 acz = _mm_sub_ps(_mm_setr_ps(vz[f[0].c], vz[f[1].c], vz[f[2].c], vz[f[3].c]), az);
+
+        // normal = AB x AC, dot = normal . (origin - A)
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(aby, acz), _mm_mul_ps(abz, acy));
+        __m128 ny = _mm_sub_ps(_mm_mul_ps(abz, acx), _mm_mul_ps(abx, acz));
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(abx, acy), _mm_mul_ps(aby, acx));
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ax), _mm_mul_ps(ny, ay)), _mm_mul_ps(nz, az));
+
+        // The dot product with the camera ray is -dot, so faces with dot > 0 are culled
+        int culled = _mm_movemask_ps(_mm_cmpgt_ps(dot, _mm_setzero_ps()));
+        for (int lane = 0; lane < 4; lane++) {
+            if (!(culled & (1 << lane))) visible_faces[num_visible++] = i + lane;
+        }
+    }
+
+    // Remaining faces that do not fill a whole register
+    int num_tail = cull_backfaces_scalar(vertices, faces, i, num_faces, visible_faces + num_visible);
+    return num_visible + num_tail;
+}
+
+SIMD_TARGET_AVX2
+static int cull_backfaces_avx2(const vertex_stream_t* vertices, const face_t* faces, int num_faces, int* visible_faces) {
+    // Offsets of the index fields of eight consecutive faces, counted in ints
+    const int face_stride = sizeof(face_t) / sizeof(int);
+    __m256i face_offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(face_stride));
+    int num_visible = 0;
+
+    int i = 0;
+    for (; i + 8 <= num_faces; i += 8) {
+        const int* face_ints = (const int*)&faces[i];
+        __m256i index_a = _mm256_i32gather_epi32(face_ints + offsetof(face_t, a) / sizeof(int), face_offsets, 4);
+        __m256i index_b = _mm256_i32gather_epi32(face_ints + offsetof(face_t, b) / sizeof(int), face_offsets, 4);
+        __m256i index_c = _mm256_i32gather_epi32(face_ints + offsetof(face_t, c) / sizeof(int), face_offsets, 4);
+
+        __m256 ax = _mm256_i32gather_ps(vertices->x, index_a, 4);
+        __m256 ay = _mm256_i32gather_ps(vertices->y, index_a, 4);
+        __m256 az = _mm256_i32gather_ps(vertices->z, index_a, 4);
+        __m256 abx = _mm256_sub_ps(_mm256_i32gather_ps(vertices->x, index_b, 4), ax);
+        __m256 aby = _mm256_sub_ps(_mm256_i32gather_ps(vertices->y, index_b, 4), ay);
+        __m256 abz = _mm256_sub_ps(_mm256_i32gather_ps(vertices->z, index_b, 4), az);
+        __m256 acx = _mm256_sub_ps(_mm256_i32gather_ps(vertices->x, index_c, 4), ax);
+        __m256 acy = _mm256_sub_ps(_mm256_i32gather_ps(vertices->y, index_c, 4), ay);
+        __m256 acz = _mm256_sub_ps(_mm256_i32gather_ps(vertices->z, index_c, 4), az);
+
+        __m256 nx = _mm256_sub_ps(_mm256_mul_ps(aby, acz), _mm256_mul_ps(abz, acy));
+        __m256 ny = _mm256_sub_ps(_mm256_mul_ps(abz, acx), _mm256_mul_ps(abx, acz));
+        __m256 nz = _mm256_sub_ps(_mm256_mul_ps(abx, acy), _mm256_mul_ps(aby, acx));
+        __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, ax), _mm256_mul_ps(ny, ay)), _mm256_mul_ps(nz, az));
+
+        int culled = _mm256_movemask_ps(_mm256_cmp_ps(dot, _mm256_setzero_ps(), _CMP_GT_OQ));
+        for (int lane = 0; lane < 8; lane++) {
+            if (!(culled & (1 << lane))) visible_faces[num_visible++] = i + lane;
+        }
+    }
+
+    int num_tail = cull_backfaces_scalar(vertices, faces, i, num_faces, visible_faces + num_visible);
+    return num_visible + num_tail;
+}
+#endif
+
+static int cull_backfaces_portable(const vertex_stream_t* vertices, const face_t* faces, int num_faces, int* visible_faces) {
+    return cull_backfaces_scalar(vertices, faces, 0, num_faces, visible_faces);
+}
+
+int cull_backfaces(const vertex_stream_t* vertices, const face_t* faces, int num_faces, int* visible_faces) {
+    static int (*kernel)(const vertex_stream_t*, const face_t*, int, int*) = NULL;
+
+    // Pick the widest kernel the CPU supports the first time we are called
+    if (kernel == NULL) {
+        kernel = cull_backfaces_portable;
+#ifdef SIMD_X86
+        if (cpu_has_avx2()) kernel = cull_backfaces_avx2;
+        else if (cpu_has_sse2()) kernel = cull_backfaces_sse2;
+#endif
+    }
+    return kernel(vertices, faces, num_faces, visible_faces);
+}
@@ -0,0 +1,15 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include "vertex_stream.h"
+#include "triangle.h"
+
+//////////////////////////////////////////////////////////////////////
+// Batch backface culling in camera space (camera at the origin).   //
+// Faces are tested 4 or 8 at a time and the indices of the faces   //
+// that look towards the camera are written to visible_faces, which //
+// needs room for num_faces entries. Returns how many survived.     //
+//////////////////////////////////////////////////////////////////////
+int cull_backfaces(const vertex_stream_t* vertices, const face_t* faces, int num_faces, int* visible_faces);
+
+#endif
@@ -93,34 +93,87 @@ void draw_pixel(int x, int y, uint32_t color) {
 
 // This function uses the DDA algorithm to rasterize a line, might switch to Bresenham's algorithm for performance
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
+    draw_line_in_rect(x0, y0, x1, y1, color, screen_rect());
+}
+
+void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color) {
+    draw_triangle_in_rect(x0, y0, x1, y1, x2, y2, color, screen_rect());
+}
+
+void draw_rectangle(int x, int y, int w, int h, uint32_t color) { 
+    draw_rectangle_in_rect(x, y, w, h, color, screen_rect());
+}
+
+rect_t screen_rect(void) {
+    rect_t rect = { 0, 0, window_width - 1, window_height - 1 };
+    return rect;
+}
+
+// Narrow the steps [first, last] of a DDA line to the ones whose coordinate can fall inside [min, max]
+static void clip_line_steps(float start, float inc, int min, int max, int* first, int* last) {
+    if (inc == 0) {
+        if (round(start) < min || round(start) > max) *last = -1;
+        return;
+    }
+    float t0 = (min - 0.5 - start) / inc;
+    float t1 = (max + 0.5 - start) / inc;
+    if (t0 > t1) {
+        float t = t0;
+        t0 = t1;
+        t1 = t;
+    }
+    // Widen by one step to stay conservative, the exact check is done per pixel
+    float lo = floor(t0) - 1;
+    float hi = ceil(t1) + 1;
+    if (lo > *first) *first = lo > *last ? *last + 1 : (int)lo;
+    if (hi < *last) *last = hi < *first ? *first - 1 : (int)hi;
+}
+
+void draw_line_in_rect(int x0, int y0, int x1, int y1, uint32_t color, rect_t rect) {
     int delta_x = x1 - x0;
     int delta_y = y1 - y0;
 
     int longest_side_length = abs(delta_x) >= abs(delta_y) ? abs(delta_x) : abs(delta_y);
+    if (longest_side_length == 0) {
+        if (x0 >= rect.min_x && x0 <= rect.max_x && y0 >= rect.min_y && y0 <= rect.max_y)
+            color_buffer[(window_width * y0) + x0] = color;
+        return;
+    }
 
     float x_inc = delta_x / (float)longest_side_length;
     float y_inc = delta_y / (float)longest_side_length;
 
-    float current_x = x0;
-    float current_y = y0;
-
-    for (int i = 0; i <= longest_side_length; i++) {
-        draw_pixel(round(current_x), round(current_y), color);
-        current_x += x_inc;
-        current_y += y_inc;
+    // Only walk the steps that can land inside the rect, lines from guard band triangles can be very long
+    int first = 0;
+    int last = longest_side_length;
+    clip_line_steps(x0, x_inc, rect.min_x, rect.max_x, &first, &last);
+    clip_line_steps(y0, y_inc, rect.min_y, rect.max_y, &first, &last);
+
+    for (int i = first; i <= last; i++) {
+        // Positions are computed from the step index, so they do not depend on where the walk starts
+        int x = round(x0 + i * x_inc);
+        int y = round(y0 + i * y_inc);
+        if (x >= rect.min_x && x <= rect.max_x && y >= rect.min_y && y <= rect.max_y)
+            color_buffer[(window_width * y) + x] = color;
     }
 }
 
-void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color) {
-    draw_line(x0, y0, x1, y1, color);
-    draw_line(x1, y1, x2, y2, color);
-    draw_line(x2, y2, x0, y0, color);
+void draw_triangle_in_rect(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, rect_t rect) {
+    draw_line_in_rect(x0, y0, x1, y1, color, rect);
+    draw_line_in_rect(x1, y1, x2, y2, color, rect);
+    draw_line_in_rect(x2, y2, x0, y0, color, rect);
 }
 
-void draw_rectangle(int x, int y, int w, int h, uint32_t color) { 
-    for (int current_y = y; current_y <= (y + h); current_y++) {
-        for (int current_x = x; current_x <= (x + w); current_x++) {
-            draw_pixel(current_x, current_y, color);
+void draw_rectangle_in_rect(int x, int y, int w, int h, uint32_t color, rect_t rect) {
+    // Only loop over the part of the rectangle that overlaps the rect
+    int min_x = x > rect.min_x ? x : rect.min_x;
+    int min_y = y > rect.min_y ? y : rect.min_y;
+    int max_x = (x + w) < rect.max_x ? (x + w) : rect.max_x;
+    int max_y = (y + h) < rect.max_y ? (y + h) : rect.max_y;
+
+    for (int current_y = min_y; current_y <= max_y; current_y++) {
+        for (int current_x = min_x; current_x <= max_x; current_x++) {
+            color_buffer[(window_width * current_y) + current_x] = color;
         }
     }
 }
\ No newline at end of file
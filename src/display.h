@@ -11,6 +11,17 @@
 #define FPS 60
 #define FRAME_TARGET_TIME (1000 / FPS)
 
+/////////////////////////////////////////////////////
+// Rectangle of screen pixels that drawing is      //
+// restricted to, min and max bounds are inclusive //
+/////////////////////////////////////////////////////
+typedef struct {
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+} rect_t;
+
 ///////////////////////
 // Window properties //
 ///////////////////////
@@ -43,4 +54,13 @@ void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
 void draw_rectangle(int x, int y, int w, int h, uint32_t color);
 
+//////////////////////////////////////////////////////////////////
+// Drawing functions that only touch the pixels inside a rect,  //
+// they produce the same pixels as above for the covered area   //
+//////////////////////////////////////////////////////////////////
+rect_t screen_rect(void);
+void draw_line_in_rect(int x0, int y0, int x1, int y1, uint32_t color, rect_t rect);
+void draw_triangle_in_rect(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, rect_t rect);
+void draw_rectangle_in_rect(int x, int y, int w, int h, uint32_t color, rect_t rect);
+
 #endif
\ No newline at end of file
@@ -13,6 +13,11 @@
 #include "upng.h"
 #include "camera.h"
 #include "clipping.h"
+#include "thread_pool.h"
+#include "tile.h"
+#include "culling.h"
+#include "scene.h"
+#include "sampler.h"
 
 // Array of triangles to render
 #define MAX_TRIANGLES_PER_MESH 1000000
@@ -24,15 +29,39 @@ int previous_frame_time = 0;
 float delta_time = 0;
 
 mat4_t proj_matrix;
-mat4_t world_matrix;
 mat4_t view_matrix;
 
+// Mesh vertices transformed to camera space, recomputed once per frame
+vertex_stream_t camera_space_vertices = { 0 };
+
+// Mesh vertices projected to homogeneous clip space and their outcodes, recomputed once per frame
+vec4_t* clip_space_vertices = NULL;
+uint16_t* clip_space_outcodes = NULL;
+int clip_space_capacity = 0;
+
+// Indices of the clusters and faces that survived culling this frame
+int* visible_clusters = NULL;
+int visible_clusters_capacity = 0;
+int* visible_faces = NULL;
+int visible_faces_capacity = 0;
+
 // Display options for the polygons
 bool show_wireframe = true;
 bool show_vertices = false;
 bool show_filled = false;
 bool show_textured = false;
-bool enable_culling = true;
+enum cull_method {
+	CULL_NONE,
+	CULL_BACKFACE,		// camera-space test before clipping
+	CULL_SCREEN_SPACE	// winding and coverage test on the projected triangle
+} cull_method = CULL_BACKFACE;
+bool enable_tiled_rendering = true;
+bool enable_guard_band = true;
+bool enable_cluster_culling = true;
+bool enable_lod = true;
+
+// Pixels one model unit covers at a depth of one, for turning the error of a level of detail into pixels
+float lod_pixels_per_unit;
 
 void setup(void) {
 	// Allocate memory for the color and depth buffers
@@ -56,15 +85,54 @@ void setup(void) {
 	float z_near = 0.1;
 	float z_far = 20.0;
 	proj_matrix = mat4_make_perspective(fov_y, aspect_y, z_near, z_far);
+	lod_pixels_per_unit = window_height / (2 * tan(fov_y / 2));
 
-	// Initialize the frustum planes
+	// Initialize the frustum planes and the guard band around the screen
 	init_frustum_planes(fov_x, fov_y, z_near, z_far);
+	init_guard_band(window_width, window_height);
+
+	// Start the worker threads and split the screen into tiles they can rasterize in parallel,
+	// without them every triangle is drawn on this thread
+	if (!thread_pool_init(0) || !init_tiles(window_width, window_height)) {
+		fprintf(stderr, "Error starting the tiled renderer, drawing on a single thread instead.\n");
+		enable_tiled_rendering = false;
+	}
+
+	// Pick the texture filtering kernels before the worker threads start sampling
+	init_sampler();
 	
-	// Load a model from an OBJ file
-	load_obj_file_data("./assets/f117.obj");
+	// Load the models and textures once, objects of the scene only refer to them
+	char* asset_names[] = { "f22", "f117", "efa" };
+	int num_assets = sizeof(asset_names) / sizeof(asset_names[0]);
+	int mesh_indices[3];
+	int texture_indices[3];
+	for (int i = 0; i < num_assets; i++) {
+		char filename[64];
+		snprintf(filename, sizeof(filename), "./assets/%s.obj", asset_names[i]);
+		int mesh_index = mesh_indices[i] = scene_add_mesh(&scene, filename);
+		snprintf(filename, sizeof(filename), "./assets/%s.png", asset_names[i]);
+		int texture_index = texture_indices[i] = scene_add_texture(&scene, filename);
+
+		// Place the objects side by side in front of the camera
+		int object_index = scene_add_object(&scene, mesh_index, texture_index);
+		if (object_index < 0) continue;
+		scene_object_t* object = &scene.objects[object_index];
+		object->rotation.x = -0.25;
+		object->translation.x = (i - (num_assets - 1) / 2.0) * 3.0;
+		object->translation.z = 8.0;
+	}
 
-	// Load texture information from a PNG file
-	load_png_texture_data("./assets/f117.png");
+	// Fly a formation of instances of the first model behind them, they all share its mesh and texture
+	int formation = scene_add_instance_batch(&scene, mesh_indices[0], texture_indices[0]);
+	for (int row = 0; row < 2 && formation >= 0; row++) {
+		for (int column = 0; column < 5; column++) {
+			mat4_t world_matrix = mat4_mul_mat4(
+				mat4_make_translation((column - 2) * 2.5, 2.5 - row, 14.0 + row * 3.0),
+				mat4_mul_mat4(mat4_make_rotation_x(-0.25), mat4_make_rotation_y(M_PI / 2))
+			);
+			scene_add_instance(&scene, formation, world_matrix, 0xFFFFFFFF);
+		}
+	}
 }
 
 void process_input(void) {
@@ -119,10 +187,55 @@ void process_input(void) {
 			show_textured = true;
 			break;
 		case SDLK_c:
-			enable_culling = true;
+			cull_method = CULL_BACKFACE;
+			break;
+		case SDLK_v:
+			cull_method = CULL_SCREEN_SPACE;
 			break;
 		case SDLK_x:
-			enable_culling = false;
+			cull_method = CULL_NONE;
+			break;
+		case SDLK_t:
+			enable_tiled_rendering = true;
+			break;
+		case SDLK_y:
+			enable_tiled_rendering = false;
+			break;
+		case SDLK_g:
+			enable_guard_band = true;
+			break;
+		case SDLK_h:
+			enable_guard_band = false;
+			break;
+		case SDLK_b:
+			enable_cluster_culling = true;
+			break;
+		case SDLK_n:
+			enable_cluster_culling = false;
+			break;
+		case SDLK_l:
+			enable_lod = true;
+			break;
+		case SDLK_k:
+			enable_lod = false;
+			break;
+		case SDLK_u:
+			texture_sampler.filter = FILTER_NEAREST;
+			break;
+		case SDLK_i:
+			texture_sampler.filter = FILTER_BILINEAR;
+			break;
+		case SDLK_o:
+			texture_sampler.filter = FILTER_TRILINEAR;
+			break;
+		case SDLK_j:
+			texture_sampler.address_u = texture_sampler.address_v = ADDRESS_WRAP;
+			break;
+		case SDLK_p:
+			texture_sampler.address_u = texture_sampler.address_v = ADDRESS_CLAMP;
+			break;
+		case SDLK_m:
+			texture_sampler.address_u = texture_sampler.address_v = ADDRESS_MIRROR;
 			break;
 		case SDLK_w:
 			camera.forward_velocity = vec3_mul(camera.direction, 5.0 * delta_time);
@@ -149,146 +262,126 @@ void process_input(void) {
 	}
 }
 
-void update(void) {
-	// Maintain target framerate
-	int time_to_wait = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);	// calculate the time that has passed since the last frame was rendered
-	if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME)						// delay the next frame only if we exceed the FRAME_TARGET_TIME
-		SDL_Delay(time_to_wait);
-
-	// Factor converted to secods to be used to update the scene objects
-	delta_time = (SDL_GetTicks() - previous_frame_time) / 1000.0;
-	
-	previous_frame_time = SDL_GetTicks();
-
-	// Initialize the array of triangles to render
-	num_triangles_to_render = 0;
-
-	//////////////////////////////////
-	// Transformations for the mesh //
-	//////////////////////////////////
-	// Rotation
-	mesh.rotation.x = -0.25;
-	mesh.rotation.y += 0.5 * delta_time;
-	// mesh.rotation.z += 0.5 * delta_time;
-
-	// Scaling
-	// mesh.scale.x += 0.002;
-	// mesh.scale.y += 0.002;
-	// mesh.scale.z += 0.002;
-
-	// Translation
-	// mesh.translation.x += 0.01;
-	// mesh.translation.y += 0.01;
-	// mesh.translation.z += 0.01;
-
-	// Move the mesh away from the camera
-	mesh.translation.z = 5.0;
-
-	// Change the camera position
-	// camera.position.x += 0.5 * delta_time;
-	// camera.position.y += 0.5 * delta_time;
-
-	// Create the view matrix
-	vec3_t target = { 0, 0, 1 };
-	mat4_t camera_yaw_rotation = mat4_make_rotation_y(camera.yaw_angle);
-	camera.direction = vec3_from_vec4(mat4_mul_vec4(camera_yaw_rotation, vec4_from_vec3(target)));
-
-	// Offset the camera position in the direction the camera is looking at
-	target = vec3_add(camera.position, camera.direction);
-	vec3_t up_direction = { 0, 1, 0 };
-
-	view_matrix = mat4_look_at(camera.position, target, up_direction);
-
-	// Create scale, rotation, and translation matrices
-	mat4_t scale_matrix = mat4_make_scale(mesh.scale.x, mesh.scale.y, mesh.scale.z);
-	mat4_t rotation_matrix_x = mat4_make_rotation_x(mesh.rotation.x);
-	mat4_t rotation_matrix_y = mat4_make_rotation_y(mesh.rotation.y);
-	mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh.rotation.z);
-	mat4_t translation_matrix = mat4_make_translation(mesh.translation.x, mesh.translation.y, mesh.translation.z);
-
-	// Loop through all the triangle faces of the mesh
-	int num_faces = array_length(mesh.faces);
-	for (int i = 0; i < num_faces; i++) {
-
-		face_t mesh_face = mesh.faces[i];
-
-		vec3_t face_vertices[3];
-		face_vertices[0] = mesh.vertices[mesh_face.a];
-		face_vertices[1] = mesh.vertices[mesh_face.b];
-		face_vertices[2] = mesh.vertices[mesh_face.c];
-
-		vec4_t transformed_vertices[3];
-
-		///////////////////////////////////////////////////////////////
-		// Apply transformations to the vertices of the current face //
-		///////////////////////////////////////////////////////////////
-		for (int j = 0; j < 3; j++) {
-			vec4_t transformed_vertex = vec4_from_vec3(face_vertices[j]);	// convert the current vertex from vec3 to vec4
-
-			// Create a world matrix combining scale, rotation and translation matrices
-			world_matrix = mat4_identity();
-			world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
-			world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
-			world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
-			world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
-			world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
-
-			// Multiply the world matrix by the original vector
-			transformed_vertex = mat4_mul_vec4(world_matrix, transformed_vertex);
+// Cull, transform and clip the faces of one placement of a mesh, appending what is left to the triangles to render
+void update_mesh_placement(const mesh_t* mesh, const texture_t* texture, uint32_t color, const mat4_t* model_view_matrix) {
+
+	//////////////////////////////////////////////////////////////
+	// Transform every vertex of the mesh to camera space once, //
+	// faces that share a vertex then read the same result      //
+	//////////////////////////////////////////////////////////////
+	// Draw the coarsest level of detail whose error stays under a pixel, it only needs the vertices at the start of the buffer
+	int lod_index = enable_lod ? select_mesh_lod(mesh, model_view_matrix, lod_pixels_per_unit, MAX_LOD_PIXEL_ERROR) : 0;
+	const mesh_lod_t* lod = &mesh->lods[lod_index];
+	vertex_stream_t lod_vertices = mesh->vertex_stream;
+	lod_vertices.count = lod->num_vertices;
+	mat4_transform_vertex_stream(model_view_matrix, &lod_vertices, &camera_space_vertices);
+
+	// Project them to clip space as well and find which frustum planes each one is outside of
+	if (camera_space_vertices.count > clip_space_capacity) {
+		clip_space_capacity = camera_space_vertices.count;
+		clip_space_vertices = (vec4_t*)realloc(clip_space_vertices, sizeof(vec4_t) * clip_space_capacity);
+		clip_space_outcodes = (uint16_t*)realloc(clip_space_outcodes, sizeof(uint16_t) * clip_space_capacity);
+	}
+	transform_to_clip_space(&proj_matrix, &camera_space_vertices, clip_space_vertices, clip_space_outcodes);
+
+	////////////////////////////////////////////////////////////////
+	// Reject whole clusters outside the frustum or facing away,  //
+	// then check backface culling for the faces of the rest in   //
+	// batches, which leaves the indices of the faces to draw     //
+	////////////////////////////////////////////////////////////////
+	int num_faces = array_length(lod->faces);
+	if (num_faces > visible_faces_capacity) {
+		visible_faces = (int*)realloc(visible_faces, sizeof(int) * num_faces);
+		visible_faces_capacity = num_faces;
+	}
 
-			// Multiply the view matrix by the vector to transform the scene to camera space
-			transformed_vertex = mat4_mul_vec4(view_matrix, transformed_vertex);
+	int num_clusters = array_length(lod->clusters);
+	if (num_clusters > visible_clusters_capacity) {
+		visible_clusters = (int*)realloc(visible_clusters, sizeof(int) * num_clusters);
+		visible_clusters_capacity = num_clusters;
+	}
 
-			transformed_vertices[j] = transformed_vertex;
+	int num_visible_faces = 0;
+	if (enable_cluster_culling) {
+		int num_visible_clusters = cull_clusters(lod->clusters, num_clusters, model_view_matrix, cull_method == CULL_BACKFACE, visible_clusters);
+		for (int i = 0; i < num_visible_clusters; i++) {
+			const cluster_t* cluster = &lod->clusters[visible_clusters[i]];
+			int* cluster_faces = visible_faces + num_visible_faces;
+			int num_cluster_faces = cluster->num_faces;
+			if (cull_method == CULL_BACKFACE) {
+				num_cluster_faces = cull_backfaces(&camera_space_vertices, lod->faces + cluster->first_face, cluster->num_faces, cluster_faces);
+				for (int j = 0; j < num_cluster_faces; j++) {
+					cluster_faces[j] += cluster->first_face;
+				}
+			} else {
+				for (int j = 0; j < num_cluster_faces; j++) {
+					cluster_faces[j] = cluster->first_face + j;
+				}
+			}
+			num_visible_faces += num_cluster_faces;
 		}
+	} else if (cull_method == CULL_BACKFACE) {
+		num_visible_faces = cull_backfaces(&camera_space_vertices, lod->faces, num_faces, visible_faces);
+	} else {
+		for (int i = 0; i < num_faces; i++) {
+			visible_faces[num_visible_faces++] = i;
+		}
+	}
 
-		////////////////////////////
-		// Check backface culling //
-		////////////////////////////
-		vec3_t vector_a = vec3_from_vec4(transformed_vertices[0]); /*   A   */
-		vec3_t vector_b = vec3_from_vec4(transformed_vertices[1]); /*  / \  */
-		vec3_t vector_c = vec3_from_vec4(transformed_vertices[2]); /* C---B */
-
-		// Get the vector subtraction of B-A and C-A
-		vec3_t vector_ab = vec3_sub(vector_b, vector_a);
-		vec3_t vector_ac = vec3_sub(vector_c, vector_a);
-		vec3_normalize(&vector_ab);
-		vec3_normalize(&vector_ac);
-
-		// Compute the face normal using cross product to find a perpendicular vector
-		vec3_t normal = vec3_cross(vector_ab, vector_ac);
-		vec3_normalize(&normal);
-
-		// Find the vector between vertex A in the triangle and the camera origin
-		vec3_t origin = { 0, 0, 0 };
-		vec3_t camera_ray = vec3_sub(origin, vector_a);
+	// Loop through all the triangle faces of the mesh that survived culling
+	for (int i = 0; i < num_visible_faces; i++) {
 
-		// Calculate how aligned the camera ray is with the face normal using the dot product
-		float dot_normal_camera = vec3_dot(normal, camera_ray);
+		face_t mesh_face = lod->faces[visible_faces[i]];
 
-		// Enable or disable back face culling
-		if (enable_culling) {
-			// Bypass the triangles that are looking away from the camera
-			if (dot_normal_camera < 0) {
-				continue;
-			}
+		// Skip the face right away if all of its vertices are outside the same frustum plane
+		uint16_t outcode_a = clip_space_outcodes[mesh_face.a];
+		uint16_t outcode_b = clip_space_outcodes[mesh_face.b];
+		uint16_t outcode_c = clip_space_outcodes[mesh_face.c];
+		if (outcode_a & outcode_b & outcode_c & OUTCODE_FRUSTUM) {
+			continue;
 		}
+		uint16_t clip_planes = planes_to_clip(outcode_a | outcode_b | outcode_c, enable_guard_band);
 
-		// Create a polygon from the original transformed triangle to be clipped
-		polygon_t polygon = create_polygon_from_triangle(
-			vec3_from_vec4(transformed_vertices[0]),
-			vec3_from_vec4(transformed_vertices[1]),
-			vec3_from_vec4(transformed_vertices[2])
-		);
+		// Fetch the already transformed camera-space vertices of the current face
+		vec3_t vector_a = vertex_stream_get(&camera_space_vertices, mesh_face.a); /*   A   */
+		vec3_t vector_b = vertex_stream_get(&camera_space_vertices, mesh_face.b); /*  / \  */
+		vec3_t vector_c = vertex_stream_get(&camera_space_vertices, mesh_face.c); /* C---B */
 
-		// Clip polygon with potential new vertices
-		clip_polygon(&polygon);
+		// Compute the face normal for lighting, only the faces that were not culled pay for the normalization
+		vec3_t normal = vec3_cross(vec3_sub(vector_b, vector_a), vec3_sub(vector_c, vector_a));
+		vec3_normalize(&normal);
 
-		// Break the polygon apart back into individual triangles
 		triangle_t triangles_after_clipping[MAX_NUM_POLY_TRIANGLES];
 		int num_triangles_after_clipping = 0;
 
-		triangles_from_polygon(&polygon, triangles_after_clipping, &num_triangles_after_clipping);
+		if (clip_planes == 0) {
+			// The face is inside the frustum, or only sticks out of its sides within the guard band
+			triangles_after_clipping[0].points[0] = clip_space_vertices[mesh_face.a];
+			triangles_after_clipping[0].points[1] = clip_space_vertices[mesh_face.b];
+			triangles_after_clipping[0].points[2] = clip_space_vertices[mesh_face.c];
+			triangles_after_clipping[0].texcoords[0] = mesh->texcoords[mesh_face.a];
+			triangles_after_clipping[0].texcoords[1] = mesh->texcoords[mesh_face.b];
+			triangles_after_clipping[0].texcoords[2] = mesh->texcoords[mesh_face.c];
+			num_triangles_after_clipping = 1;
+		} else {
+			// Create a polygon from the clip-space triangle and clip it against only the planes it has to,
+			// the texture coordinates are interpolated along with the positions of the new vertices
+			float attributes[3][NUM_VERTEX_ATTRIBUTES] = {
+				{ mesh->texcoords[mesh_face.a].u, mesh->texcoords[mesh_face.a].v },
+				{ mesh->texcoords[mesh_face.b].u, mesh->texcoords[mesh_face.b].v },
+				{ mesh->texcoords[mesh_face.c].u, mesh->texcoords[mesh_face.c].v }
+			};
+			polygon_t polygon = create_polygon_from_triangle(
+				clip_space_vertices[mesh_face.a],
+				clip_space_vertices[mesh_face.b],
+				clip_space_vertices[mesh_face.c],
+				attributes
+			);
+			clip_polygon(&polygon, clip_planes);
+
+			// Break the polygon apart back into individual triangles
+			triangles_from_polygon(&polygon, triangles_after_clipping, &num_triangles_after_clipping);
+		}
 
 		// Loop all the assembled triangles after clippig
 		for (int t = 0; t < num_triangles_after_clipping; t++) {
@@ -299,8 +392,13 @@ void update(void) {
 			////////////////////////////////////////
 			vec4_t projected_points[3];
 			for (int j = 0; j < 3; j++) {
-				// Project the current vertex using the projection matrix
-				projected_points[j] = mat4_mul_vec4_project(proj_matrix, triangle_after_clipping.points[j]);
+				// Perform perspective divide, w keeps the original z value for perspective correct interpolation
+				projected_points[j] = triangle_after_clipping.points[j];
+				if (projected_points[j].w != 0.0) {
+					projected_points[j].x /= projected_points[j].w;
+					projected_points[j].y /= projected_points[j].w;
+					projected_points[j].z /= projected_points[j].w;
+				}
 
 				// Scale into the view
 				projected_points[j].x *= window_width / 2.0;
@@ -315,11 +413,20 @@ void update(void) {
 				projected_points[j].y += (window_height / 2.0);
 			}
 
+			// Screen-space culling drops back faces by their winding, triangles that snap to zero area and
+			// small triangles that fall between the pixel centers, they would only cost binning and a rasterizer setup
+			if (cull_method == CULL_SCREEN_SPACE) {
+				if (snapped_triangle_area(projected_points[0], projected_points[1], projected_points[2]) <= 0 ||
+					is_snapped_triangle_empty(projected_points[0], projected_points[1], projected_points[2])) {
+					continue;
+				}
+			}
+
 			////////////////////////
 			// Calculate lighting //
 			////////////////////////
 			float light_intensity_factor = -vec3_dot(normal, light.direction);							// invert the result because the light is pointing against the face normal
-			uint32_t triangle_color = light_apply_intensity(mesh_face.color, light_intensity_factor);	// get the new color based on the angle between the face normal and the light direction
+			uint32_t triangle_color = light_apply_intensity(color, light_intensity_factor);	// get the new color based on the angle between the face normal and the light direction
 
 			// Save the projected triangle to the array of triangles to render
 			triangle_t triangle_to_render = {
@@ -329,11 +436,12 @@ void update(void) {
 					{ projected_points[2].x, projected_points[2].y, projected_points[2].z, projected_points[2].w }
 				},
 				.texcoords = {
-					{ mesh_face.a_uv.u, mesh_face.a_uv.v },
-					{ mesh_face.b_uv.u, mesh_face.b_uv.v },
-					{ mesh_face.c_uv.u, mesh_face.c_uv.v }
+					triangle_after_clipping.texcoords[0],
+					triangle_after_clipping.texcoords[1],
+					triangle_after_clipping.texcoords[2]
 				},
 				.color = triangle_color,
+				.texture = texture
 			};
 
 			if (num_triangles_to_render < MAX_TRIANGLES_PER_MESH) {
@@ -344,42 +452,138 @@ void update(void) {
 	}	
 }
 
-void render(void) {
-	// Render all projected triangles
-	for (int i = 0; i < num_triangles_to_render; i++) {
-		triangle_t triangle = triangles_to_render[i];
-
-		if (show_filled) {
-			draw_filled_triangle(
-				triangle.points[0].x, triangle.points[0].y, triangle.points[0].z, triangle.points[0].w,
-				triangle.points[1].x, triangle.points[1].y, triangle.points[1].z, triangle.points[1].w,
-				triangle.points[2].x, triangle.points[2].y, triangle.points[2].z, triangle.points[2].w,
-				triangle.color
-			);
-		}
-		if (show_textured) {
-			draw_textured_triangle(
-				triangle.points[0].x, triangle.points[0].y, triangle.points[0].z, triangle.points[0].w, triangle.texcoords[0].u, triangle.texcoords[0].v,
-				triangle.points[1].x, triangle.points[1].y, triangle.points[1].z, triangle.points[1].w, triangle.texcoords[1].u, triangle.texcoords[1].v,
-				triangle.points[2].x, triangle.points[2].y, triangle.points[2].z, triangle.points[2].w, triangle.texcoords[2].u, triangle.texcoords[2].v,
-				mesh_texture
-			);
+void update(void) {
+	// Maintain target framerate
+	int time_to_wait = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);	// calculate the time that has passed since the last frame was rendered
+	if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME)						// delay the next frame only if we exceed the FRAME_TARGET_TIME
+		SDL_Delay(time_to_wait);
+
+	// Factor converted to secods to be used to update the scene objects
+	delta_time = (SDL_GetTicks() - previous_frame_time) / 1000.0;
+	
+	previous_frame_time = SDL_GetTicks();
+
+	// Initialize the array of triangles to render
+	num_triangles_to_render = 0;
+
+	/////////////////////////////////////
+	// Transformations for the objects //
+	/////////////////////////////////////
+	for (int i = 0; i < array_length(scene.objects); i++) {
+		scene_object_t* object = &scene.objects[i];
+
+		// Rotation
+		object->rotation.y += 0.5 * delta_time;
+		// object->rotation.z += 0.5 * delta_time;
+
+		// Scaling
+		// object->scale.x += 0.002;
+		// object->scale.y += 0.002;
+		// object->scale.z += 0.002;
+
+		// Translation
+		// object->translation.x += 0.01;
+		// object->translation.y += 0.01;
+		// object->translation.z += 0.01;
+	}
+
+	// Change the camera position
+	// camera.position.x += 0.5 * delta_time;
+	// camera.position.y += 0.5 * delta_time;
+
+	// Create the view matrix
+	vec3_t target = { 0, 0, 1 };
+	mat4_t camera_yaw_rotation = mat4_make_rotation_y(camera.yaw_angle);
+	camera.direction = vec3_from_vec4(mat4_mul_vec4(camera_yaw_rotation, vec4_from_vec3(target)));
+
+	// Offset the camera position in the direction the camera is looking at
+	target = vec3_add(camera.position, camera.direction);
+	vec3_t up_direction = { 0, 1, 0 };
+
+	view_matrix = mat4_look_at(camera.position, target, up_direction);
+
+	// Turn every object of the scene into triangles to render, in scene order
+	for (int i = 0; i < array_length(scene.objects); i++) {
+		scene_object_t* object = &scene.objects[i];
+
+		// Get the matrix that takes the mesh vertices straight to camera space, it is only rebuilt when the object or camera moved
+		mat4_t* model_view_matrix = object_model_view_matrix(&scene, object, &view_matrix);
+
+		// Skip the whole object when its bounding sphere is outside the frustum
+		if (is_object_outside_frustum(object, &view_matrix)) {
+			continue;
 		}
-		if (show_wireframe) {
-			draw_triangle(
-				triangle.points[0].x,
-				triangle.points[0].y,
-				triangle.points[1].x,
-				triangle.points[1].y,
-				triangle.points[2].x,
-				triangle.points[2].y,
-				0xFFFFFFFF
-			);
+		const mesh_t* mesh = &scene.meshes[object->mesh_index];
+		const texture_t* texture = object->texture_index >= 0 ? &scene.textures[object->texture_index] : NULL;
+		update_mesh_placement(mesh, texture, object->color, model_view_matrix);
+	}
+
+	// Then every instance of the instanced meshes, which only bring their own matrix and color
+	for (int b = 0; b < array_length(scene.batches); b++) {
+		const instance_batch_t* batch = &scene.batches[b];
+		const mesh_t* mesh = &scene.meshes[batch->mesh_index];
+		const texture_t* texture = batch->texture_index >= 0 ? &scene.textures[batch->texture_index] : NULL;
+
+		for (int i = 0; i < array_length(batch->instances); i++) {
+			const mesh_instance_t* instance = &batch->instances[i];
+			mat4_t model_view_matrix = mat4_mul_mat4(view_matrix, instance->world_matrix);
+			if (is_mesh_outside_frustum(mesh, &model_view_matrix)) {
+				continue;
+			}
+			update_mesh_placement(mesh, texture, instance->color, &model_view_matrix);
 		}
-		if (show_vertices) {
-			draw_rectangle(triangle.points[0].x - 2, triangle.points[0].y - 2, 4, 4, 0xFFFF0000);
-			draw_rectangle(triangle.points[1].x - 2, triangle.points[1].y - 2, 4, 4, 0xFFFF0000);
-			draw_rectangle(triangle.points[2].x - 2, triangle.points[2].y - 2, 4, 4, 0xFFFF0000);
+	}
+}
+
+// Draw one triangle with the current display options, only touching the pixels inside rect
+void render_triangle(triangle_t* triangle, rect_t rect) {
+	if (show_filled) {
+		draw_filled_triangle_in_rect(
+			triangle->points[0].x, triangle->points[0].y, triangle->points[0].w,
+			triangle->points[1].x, triangle->points[1].y, triangle->points[1].w,
+			triangle->points[2].x, triangle->points[2].y, triangle->points[2].w,
+			triangle->color, rect
+		);
+	}
+	if (show_textured) {
+		draw_textured_triangle_in_rect(
+			triangle->points[0].x, triangle->points[0].y, triangle->points[0].w, triangle->texcoords[0].u, triangle->texcoords[0].v,
+			triangle->points[1].x, triangle->points[1].y, triangle->points[1].w, triangle->texcoords[1].u, triangle->texcoords[1].v,
+			triangle->points[2].x, triangle->points[2].y, triangle->points[2].w, triangle->texcoords[2].u, triangle->texcoords[2].v,
+			triangle->texture, rect
+		);
+	}
+	if (show_wireframe) {
+		draw_triangle_in_rect(
+			triangle->points[0].x,
+			triangle->points[0].y,
+			triangle->points[1].x,
+			triangle->points[1].y,
+			triangle->points[2].x,
+			triangle->points[2].y,
+			0xFFFFFFFF, rect
+		);
+	}
+	if (show_vertices) {
+		draw_rectangle_in_rect(triangle->points[0].x - 2, triangle->points[0].y - 2, 4, 4, 0xFFFF0000, rect);
+		draw_rectangle_in_rect(triangle->points[1].x - 2, triangle->points[1].y - 2, 4, 4, 0xFFFF0000, rect);
+		draw_rectangle_in_rect(triangle->points[2].x - 2, triangle->points[2].y - 2, 4, 4, 0xFFFF0000, rect);
+	}
+}
+
+void render(void) {
+	// Sort the triangles into screen tiles, when the bins cannot be filled drawing falls back to this thread
+	if (enable_tiled_rendering && !bin_triangles_into_tiles(triangles_to_render, num_triangles_to_render)) {
+		enable_tiled_rendering = false;
+	}
+	if (enable_tiled_rendering) {
+		// Let the thread pool rasterize the tiles in parallel
+		render_tiles(render_triangle);
+	} else {
+		// Render all projected triangles on this thread
+		rect_t rect = screen_rect();
+		for (int i = 0; i < num_triangles_to_render; i++) {
+			render_triangle(&triangles_to_render[i], rect);
 		}
 	}
 
@@ -393,9 +597,14 @@ void render(void) {
 void free_resources(void) {
 	free(z_buffer);
 	free(color_buffer);
-	upng_free(png_texture);
-	array_free(mesh.faces);
-	array_free(mesh.vertices);
+	free_scene(&scene);
+	vertex_stream_free(&camera_space_vertices);
+	free(visible_clusters);
+	free(visible_faces);
+	free(clip_space_vertices);
+	free(clip_space_outcodes);
+	free_tiles();
+	thread_pool_destroy();
 }
 
 int main(void) {
@@ -0,0 +1,53 @@
+// madvise is not in C99 or POSIX, glibc only declares it when asked to
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mapped_file.h"
+
+bool map_file(const char* filename, mapped_file_t* file, bool is_writable) {
+    file->data = NULL;
+    file->size = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening %s.\n", filename);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error reading the size of %s.\n", filename);
+        close(fd);
+        return false;
+    }
+
+    // An empty file is valid but cannot be mapped
+    if (st.st_size > 0) {
+        int protection = is_writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* data = mmap(NULL, (size_t)st.st_size, protection, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "Error mapping %s.\n", filename);
+            close(fd);
+            return false;
+        }
+        // The whole file is read front to back, let the kernel read ahead aggressively
+        madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+        file->data = (char*)data;
+        file->size = (size_t)st.st_size;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    return true;
+}
+
+void unmap_file(mapped_file_t* file) {
+    if (file->data != NULL) {
+        munmap(file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
@@ -0,0 +1,20 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////
+// A file mapped into memory, readers walk the bytes in place //
+// instead of copying them into buffers. Writable mappings    //
+// are private, writes never reach the file on disk.          //
+////////////////////////////////////////////////////////////////
+typedef struct {
+    char* data;     // NULL when nothing is mapped
+    size_t size;
+} mapped_file_t;
+
+bool map_file(const char* filename, mapped_file_t* file, bool is_writable);
+void unmap_file(mapped_file_t* file);
+
+#endif
@@ -1,4 +1,5 @@
 #include "matrix.h"
+#include "simd.h"
 
 /////////////////////////////////////////////////////
 // Implementation of functions for matrix creation //
@@ -113,11 +114,21 @@ mat4_t mat4_mul_mat4(mat4_t a, mat4_t b) {
     return m;
 }
 
+// Largest factor the matrix stretches any direction by, the length of its longest scaled axis
+float mat4_max_scale(const mat4_t* m) {
+    float scale = 0;
+    for (int j = 0; j < 3; j++) {
+        float length = sqrtf(m->m[0][j] * m->m[0][j] + m->m[1][j] * m->m[1][j] + m->m[2][j] * m->m[2][j]);
+        if (length > scale) scale = length;
+    }
+    return scale;
+}
+
 mat4_t mat4_make_perspective(float fov, float aspect, float znear, float zfar) {
     mat4_t m = {{{ 0 }}};
     m.m[0][0] = aspect * (1 / tan(fov / 2));
     m.m[1][1] = 1 / tan(fov / 2);
-    m.m[2][2] = zfar / zfar - znear;
+    m.m[2][2] = zfar / (zfar - znear);
     m.m[2][3] = (-zfar * znear) / (zfar - znear);
     m.m[3][2] = 1;
     
@@ -136,4 +147,82 @@ vec4_t mat4_mul_vec4_project(mat4_t mat_proj, vec4_t v) {
     }
 
     return result;
+}
+
+/////////////////////////////////////////////////////////////////
+// Vertex stream transform kernels, the streams are aligned and //
+// padded so the SIMD kernels only ever handle whole registers  //
+/////////////////////////////////////////////////////////////////
+static void transform_vertex_stream_scalar(const mat4_t* m, const vertex_stream_t* in, vertex_stream_t* out) {
+    for (int i = 0; i < in->count; i++) {
+        float x = in->x[i], y = in->y[i], z = in->z[i];
+        out->x[i] = m->m[0][0] * x + m->m[0][1] * y + m->m[0][2] * z + m->m[0][3];
+        out->y[i] = m->m[1][0] * x + m->m[1][1] * y + m->m[1][2] * z + m->m[1][3];
+        out->z[i] = m->m[2][0] * x + m->m[2][1] * y + m->m[2][2] * z + m->m[2][3];
+    }
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET_SSE2
+static void transform_vertex_stream_sse2(const mat4_t* m, const vertex_stream_t* in, vertex_stream_t* out) {
+    __m128 rows[3][4];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 4; c++) {
+            rows[r][c] = _mm_set1_ps(m->m[r][c]);
+        }
+    }
+    float* out_streams[3] = { out->x, out->y, out->z };
+
+    for (int i = 0; i < in->count; i += 4) {
+        __m128 x = _mm_load_ps(in->x + i);
+        __m128 y = _mm_load_ps(in->y + i);
+        __m128 z = _mm_load_ps(in->z + i);
+        for (int r = 0; r < 3; r++) {
+            __m128 sum = _mm_mul_ps(rows[r][0], x);
+            sum = _mm_add_ps(sum, _mm_mul_ps(rows[r][1], y));
+            sum = _mm_add_ps(sum, _mm_mul_ps(rows[r][2], z));
+            _mm_store_ps(out_streams[r] + i, _mm_add_ps(sum, rows[r][3]));
+        }
+    }
+}
+
+SIMD_TARGET_AVX2
+static void transform_vertex_stream_avx2(const mat4_t* m, const vertex_stream_t* in, vertex_stream_t* out) {
+    __m256 rows[3][4];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 4; c++) {
+            rows[r][c] = _mm256_set1_ps(m->m[r][c]);
+        }
+    }
+    float* out_streams[3] = { out->x, out->y, out->z };
+
+    for (int i = 0; i < in->count; i += 8) {
+        __m256 x = _mm256_load_ps(in->x + i);
+        __m256 y = _mm256_load_ps(in->y + i);
+        __m256 z = _mm256_load_ps(in->z + i);
+        for (int r = 0; r < 3; r++) {
+            __m256 sum = _mm256_mul_ps(rows[r][0], x);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(rows[r][1], y));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(rows[r][2], z));
+            _mm256_store_ps(out_streams[r] + i, _mm256_add_ps(sum, rows[r][3]));
+        }
+    }
+}
+#endif
+
+void mat4_transform_vertex_stream(const mat4_t* m, const vertex_stream_t* in, vertex_stream_t* out) {
+    static void (*kernel)(const mat4_t*, const vertex_stream_t*, vertex_stream_t*) = NULL;
+
+    // Pick the widest kernel the CPU supports the first time we are called
+    if (kernel == NULL) {
+        kernel = transform_vertex_stream_scalar;
+#ifdef SIMD_X86
+        if (cpu_has_avx2()) kernel = transform_vertex_stream_avx2;
+        else if (cpu_has_sse2()) kernel = transform_vertex_stream_sse2;
+#endif
+    }
+
+    vertex_stream_reserve(out, in->count);
+    out->count = in->count;
+    kernel(m, in, out);
 }
\ No newline at end of file
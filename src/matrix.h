@@ -3,6 +3,7 @@
 
 #include <math.h>
 #include "vector.h"
+#include "vertex_stream.h"
 
 ////////////////////////////////////////
 // Struct definition for a 4x4 matrix //
@@ -29,5 +30,13 @@ mat4_t mat4_look_at(vec3_t eye, vec3_t target, vec3_t up);
 vec4_t mat4_mul_vec4_project(mat4_t mat_proj, vec4_t v); // used for projection
 vec4_t mat4_mul_vec4(mat4_t m, vec4_t v);
 mat4_t mat4_mul_mat4(mat4_t a, mat4_t b);
+float mat4_max_scale(const mat4_t* m);  // ignores the translation and projection rows
+
+/////////////////////////////////////////////////////////////
+// Transform points stored as vertex streams in one batch, //
+// using SSE2 or AVX2 when the CPU has them. out only gets //
+// x, y and z, so the matrix must be affine.               //
+/////////////////////////////////////////////////////////////
+void mat4_transform_vertex_stream(const mat4_t* m, const vertex_stream_t* in, vertex_stream_t* out);
 
 #endif
\ No newline at end of file
@@ -3,104 +3,262 @@
 #include <stdlib.h>
 #include "mesh.h"
 #include "array.h"
+#include "obj.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "clipping.h"
 
-mesh_t mesh = {
-    .vertices = NULL,
-    .faces = NULL,
-    .rotation = { 0, 0, 0 },
-    .scale = { 1.0, 1.0, 1.0 },
-    .translation = { 0, 0, 0 }
+// Every side has its own four corners, the sides meet at the same positions with different texture coordinates
+vec3_t cube_vertices[N_CUBE_VERTICES] = {
+    // front
+    { .x = -1, .y = -1, .z = -1 },
+    { .x = -1, .y =  1, .z = -1 },
+    { .x =  1, .y =  1, .z = -1 },
+    { .x =  1, .y = -1, .z = -1 },
+    // right
+    { .x =  1, .y = -1, .z = -1 },
+    { .x =  1, .y =  1, .z = -1 },
+    { .x =  1, .y =  1, .z =  1 },
+    { .x =  1, .y = -1, .z =  1 },
+    // back
+    { .x =  1, .y = -1, .z =  1 },
+    { .x =  1, .y =  1, .z =  1 },
+    { .x = -1, .y =  1, .z =  1 },
+    { .x = -1, .y = -1, .z =  1 },
+    // left
+    { .x = -1, .y = -1, .z =  1 },
+    { .x = -1, .y =  1, .z =  1 },
+    { .x = -1, .y =  1, .z = -1 },
+    { .x = -1, .y = -1, .z = -1 },
+    // top
+    { .x = -1, .y =  1, .z = -1 },
+    { .x = -1, .y =  1, .z =  1 },
+    { .x =  1, .y =  1, .z =  1 },
+    { .x =  1, .y =  1, .z = -1 },
+    // bottom
+    { .x =  1, .y = -1, .z =  1 },
+    { .x = -1, .y = -1, .z =  1 },
+    { .x = -1, .y = -1, .z = -1 },
+    { .x =  1, .y = -1, .z = -1 }
 };
 
-vec3_t cube_vertices[N_CUBE_VERTICES] = {
-    { .x = -1, .y = -1, .z = -1 }, // 1
-    { .x = -1, .y =  1, .z = -1 }, // 2
-    { .x =  1, .y =  1, .z = -1 }, // 3
-    { .x =  1, .y = -1, .z = -1 }, // 4
-    { .x =  1, .y =  1, .z =  1 }, // 5
-    { .x =  1, .y = -1, .z =  1 }, // 6
-    { .x = -1, .y =  1, .z =  1 }, // 7
-    { .x = -1, .y = -1, .z =  1 }  // 8
+tex2_t cube_texcoords[N_CUBE_VERTICES] = {
+    // front
+    { .u = 0, .v = 1 },
+    { .u = 0, .v = 0 },
+    { .u = 1, .v = 0 },
+    { .u = 1, .v = 1 },
+    // right
+    { .u = 0, .v = 1 },
+    { .u = 0, .v = 0 },
+    { .u = 1, .v = 0 },
+    { .u = 1, .v = 1 },
+    // back
+    { .u = 0, .v = 1 },
+    { .u = 0, .v = 0 },
+    { .u = 1, .v = 0 },
+    { .u = 1, .v = 1 },
+    // left
+    { .u = 0, .v = 1 },
+    { .u = 0, .v = 0 },
+    { .u = 1, .v = 0 },
+    { .u = 1, .v = 1 },
+    // top
+    { .u = 0, .v = 1 },
+    { .u = 0, .v = 0 },
+    { .u = 1, .v = 0 },
+    { .u = 1, .v = 1 },
+    // bottom
+    { .u = 0, .v = 1 },
+    { .u = 0, .v = 0 },
+    { .u = 1, .v = 0 },
+    { .u = 1, .v = 1 }
 };
 
 face_t cube_faces[N_CUBE_FACES] = {
     // front
-    { .a = 1, .b = 2, .c = 3, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 1, .b = 3, .c = 4, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF },
+    { .a = 0, .b = 1, .c = 2 },
+    { .a = 0, .b = 2, .c = 3 },
     // right
-    { .a = 4, .b = 3, .c = 5, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 4, .b = 5, .c = 6, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF },
+    { .a = 4, .b = 5, .c = 6 },
+    { .a = 4, .b = 6, .c = 7 },
     // back
-    { .a = 6, .b = 5, .c = 7, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 6, .b = 7, .c = 8, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF },
+    { .a = 8, .b = 9, .c = 10 },
+    { .a = 8, .b = 10, .c = 11 },
     // left
-    { .a = 8, .b = 7, .c = 2, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 8, .b = 2, .c = 1, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF },
+    { .a = 12, .b = 13, .c = 14 },
+    { .a = 12, .b = 14, .c = 15 },
     // top
-    { .a = 2, .b = 7, .c = 5, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 2, .b = 5, .c = 3, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF },
+    { .a = 16, .b = 17, .c = 18 },
+    { .a = 16, .b = 18, .c = 19 },
     // bottom
-    { .a = 6, .b = 8, .c = 1, .a_uv = { 0, 1 }, .b_uv = { 0, 0 }, .c_uv = { 1, 0 }, .color = 0xFFFFFFFF },
-    { .a = 6, .b = 1, .c = 4, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF }
+    { .a = 20, .b = 21, .c = 22 },
+    { .a = 20, .b = 22, .c = 23 }
 };
 
-void load_cube_mesh_data(void) {
+void load_cube_mesh_data(mesh_t* m) {
     for (int i = 0; i < N_CUBE_VERTICES; i++) {
         vec3_t cube_vertex = cube_vertices[i];
-        array_push(mesh.vertices, cube_vertex);
+        tex2_t cube_texcoord = cube_texcoords[i];
+        array_push(m->vertices, cube_vertex);
+        array_push(m->texcoords, cube_texcoord);
+        vertex_stream_push(&m->vertex_stream, cube_vertex);
     }
 
+    // The cube is too small for coarser levels
+    mesh_lod_t* lod = &m->lods[0];
     for (int i = 0; i < N_CUBE_FACES; i++) {
         face_t cube_face = cube_faces[i];
-        array_push(mesh.faces, cube_face);
+        array_push(lod->faces, cube_face);
     }
+    lod->clusters = build_clusters(m->vertices, lod->faces, N_CUBE_FACES);
+    lod->num_vertices = N_CUBE_VERTICES;
+    lod->error = 0;
+    m->num_lods = 1;
+    vertex_stream_bounds(&m->vertex_stream, &m->bounds_min, &m->bounds_max);
 }
 
-void load_obj_file_data(char* filename) {
-    FILE* file;
-    file = fopen(filename, "r");
-    char line[1024];
+// Simplify every level from the one before it, so the vertices a level uses are a subset of the ones
+// the finer levels use. The vertices then go in first use order from the coarsest level up, which
+// leaves the vertices of every level at the start of the buffer.
+static void build_mesh_lods(mesh_t* m) {
+    int num_vertices = array_length(m->vertices);
+    m->lods[0].error = 0;
+    m->num_lods = 1;
 
-    tex2_t* texcoords = NULL;
+    while (m->num_lods < MAX_MESH_LODS) {
+        const mesh_lod_t* previous = &m->lods[m->num_lods - 1];
+        int num_faces = array_length(previous->faces);
+        int target_faces = (int)(num_faces * LOD_FACE_RATIO);
+        if (target_faces < MIN_LOD_FACES) break;
 
-    // Loop through all the lines in the file
-    while(fgets(line, 1024, file)) {
+        face_t* faces = (face_t*)malloc(sizeof(face_t) * num_faces);
+        memcpy(faces, previous->faces, sizeof(face_t) * num_faces);
+        float error;
+        int num_simplified = simplify_faces(m->vertices, num_vertices, faces, num_faces, target_faces, &error);
 
-        // If the current line has vertex information
-        if (strncmp(line, "v ", 2) == 0) {
-            vec3_t vertex;
-            sscanf(line, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-            array_push(mesh.vertices, vertex);
+        // Locked seams and borders can stop the simplifier early, a level that is hardly smaller is not worth drawing
+        if (num_simplified > num_faces * (1 + LOD_FACE_RATIO) / 2) {
+            free(faces);
+            break;
         }
-        else if (strncmp(line, "vt ", 3) == 0) {
-            tex2_t texcoord;
-            sscanf(line, "vt %f %f", &texcoord.u, &texcoord.v);
-            array_push(texcoords, texcoord);
+        mesh_lod_t* lod = &m->lods[m->num_lods++];
+        lod->faces = array_hold(NULL, num_simplified, sizeof(face_t));
+        memcpy(lod->faces, faces, sizeof(face_t) * num_simplified);
+        lod->error = previous->error + error;
+        free(faces);
+    }
+
+    int total_faces = 0;
+    for (int i = 0; i < m->num_lods; i++) {
+        int num_faces = array_length(m->lods[i].faces);
+        optimize_face_order(m->lods[i].faces, num_faces, num_vertices);
+        total_faces += num_faces;
+    }
+
+    face_t* all_faces = (face_t*)malloc(sizeof(face_t) * total_faces);
+    int offset = 0;
+    for (int i = m->num_lods - 1; i >= 0; i--) {
+        int num_faces = array_length(m->lods[i].faces);
+        memcpy(all_faces + offset, m->lods[i].faces, sizeof(face_t) * num_faces);
+        offset += num_faces;
+    }
+    reorder_vertices_by_first_use(all_faces, total_faces, m->vertices, m->texcoords, num_vertices);
+
+    for (int i = 0; i < m->num_lods; i++) {
+        mesh_lod_t* lod = &m->lods[i];
+        int num_faces = array_length(lod->faces);
+        offset -= num_faces;
+        memcpy(lod->faces, all_faces + offset, sizeof(face_t) * num_faces);
+
+        lod->num_vertices = 0;
+        for (int f = 0; f < num_faces; f++) {
+            int last = lod->faces[f].a > lod->faces[f].b ? lod->faces[f].a : lod->faces[f].b;
+            if (lod->faces[f].c > last) last = lod->faces[f].c;
+            if (last + 1 > lod->num_vertices) lod->num_vertices = last + 1;
         }
-        // If the current line has face information
-        else if (strncmp(line, "f ", 2) == 0) {
-            int vertex_indices[3];
-            int texture_indices[3];
-            int normal_indices[3];
-
-            sscanf(
-                line, "f %d/%d/%d %d/%d/%d %d/%d/%d",
-                &vertex_indices[0], &texture_indices[0], &normal_indices[0],
-                &vertex_indices[1], &texture_indices[1], &normal_indices[1],
-                &vertex_indices[2], &texture_indices[2], &normal_indices[2]            
-            );
-
-            face_t face = {
-                .a = vertex_indices[0] - 1,
-                .b = vertex_indices[1] - 1,
-                .c = vertex_indices[2] - 1,
-                .a_uv = texcoords[texture_indices[0] - 1],
-                .b_uv = texcoords[texture_indices[1] - 1],
-                .c_uv = texcoords[texture_indices[2] - 1],
-                .color = 0xFFFFFFFF
-            };
-            array_push(mesh.faces, face);
+
+        // Clusters follow the optimized order, consecutive faces share vertices and stay close together
+        lod->clusters = build_clusters(m->vertices, lod->faces, num_faces);
+    }
+    free(all_faces);
+}
+
+bool load_obj_file_data(mesh_t* m, char* filename) {
+    // A valid binary cache next to the OBJ file is mapped in place of parsing the text
+    if (load_mesh_cache(filename, m)) {
+        return true;
+    }
+
+    obj_data_t obj;
+    if (!obj_load(filename, &obj)) {
+        return false;
+    }
+
+    // The parsed arrays become the mesh arrays as they are, only the SoA copy is built here
+    m->vertices = obj.vertices;
+    m->texcoords = obj.texcoords;
+    m->lods[0].faces = obj.faces;
+
+    // Simplify and reorder for locality once here, the cache stores the result
+    build_mesh_lods(m);
+
+    vertex_stream_from_vec3(&m->vertex_stream, m->vertices, array_length(m->vertices));
+    vertex_stream_bounds(&m->vertex_stream, &m->bounds_min, &m->bounds_max);
+
+    save_mesh_cache(filename, m);
+    return true;
+}
+
+void free_mesh(mesh_t* m) {
+    // Arrays loaded from a mesh cache live inside its mapping and go away with it
+    if (m->cache_file.data != NULL) {
+        unmap_file(&m->cache_file);
+    } else {
+        array_free(m->vertices);
+        array_free(m->texcoords);
+        for (int i = 0; i < m->num_lods; i++) {
+            array_free(m->lods[i].faces);
+            array_free(m->lods[i].clusters);
         }
     }
-    array_free(texcoords);
-}
\ No newline at end of file
+    vertex_stream_free(&m->vertex_stream);
+    m->vertices = NULL;
+    m->texcoords = NULL;
+    memset(m->lods, 0, sizeof(m->lods));
+    m->num_lods = 0;
+}
+
+void mesh_bounding_sphere(const mesh_t* m, vec3_t* center, float* radius) {
+    *center = vec3_mul(vec3_add(m->bounds_min, m->bounds_max), 0.5);
+    *radius = vec3_length(vec3_sub(m->bounds_max, *center));
+}
+
+// True when the bounding sphere of the mesh, moved to camera space, lies fully outside the frustum
+bool is_mesh_outside_frustum(const mesh_t* m, const mat4_t* model_view_matrix) {
+    vec3_t center;
+    float radius;
+    mesh_bounding_sphere(m, &center, &radius);
+    center = vec3_from_vec4(mat4_mul_vec4(*model_view_matrix, vec4_from_vec3(center)));
+    return is_sphere_outside_frustum(center, radius * mat4_max_scale(model_view_matrix));
+}
+
+// Coarsest level whose error, seen at the closest point of the bounds, covers at most max_pixel_error pixels
+int select_mesh_lod(const mesh_t* m, const mat4_t* model_view_matrix, float pixels_per_unit, float max_pixel_error) {
+    vec3_t center;
+    float radius;
+    mesh_bounding_sphere(m, &center, &radius);
+    float scale = mat4_max_scale(model_view_matrix);
+
+    // Depth of the bounding sphere's nearest point, the camera looks down +z
+    const float (*a)[4] = model_view_matrix->m;
+    float depth = a[2][0] * center.x + a[2][1] * center.y + a[2][2] * center.z + a[2][3] - radius * scale;
+    if (depth <= 0) return 0;
+
+    for (int i = m->num_lods - 1; i > 0; i--) {
+        float pixels = m->lods[i].error * scale * pixels_per_unit / depth;
+        if (pixels <= max_pixel_error) return i;
+    }
+    return 0;
+}
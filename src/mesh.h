@@ -1,38 +1,69 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <stdbool.h>
 #include "vector.h"
+#include "matrix.h"
+#include "vertex_stream.h"
 #include "triangle.h"
+#include "mapped_file.h"
+#include "cluster.h"
 
 ///////////////////////////////////////////////
 // Constants for the cube vertices and faces //
 ///////////////////////////////////////////////
-#define N_CUBE_VERTICES 8
+#define N_CUBE_VERTICES (6 * 4)
 #define N_CUBE_FACES (6 * 2)
 
 /////////////////////////////////////////////////////
 // These are used for the cube, might delete later //
 /////////////////////////////////////////////////////
 extern vec3_t cube_vertices[N_CUBE_VERTICES];
+extern tex2_t cube_texcoords[N_CUBE_VERTICES];
 extern face_t cube_faces[N_CUBE_FACES];
 
+/////////////////////////////////////////////////////////////
+// Levels of detail, all drawn from the same vertex buffer. //
+// Level 0 is the full mesh and every further level has     //
+// about LOD_FACE_RATIO of the faces of the one before      //
+/////////////////////////////////////////////////////////////
+#define MAX_MESH_LODS 6
+#define LOD_FACE_RATIO 0.25f
+#define MIN_LOD_FACES 256       // no level is simplified down to fewer faces than this
+#define MAX_LOD_PIXEL_ERROR 1.0f
+
+typedef struct {
+    face_t* faces;          // dynamic array of faces
+    cluster_t* clusters;    // dynamic array of face clusters culled as a whole
+    int num_vertices;       // the faces only use this many vertices from the start of the vertex buffer
+    float error;            // how far the surface can be from the full mesh, in model space units
+} mesh_lod_t;
+
 ////////////////////////////////////
 // Struct for dynamic size meshes //
 ////////////////////////////////////
+// Only the shape lives here, where and how a mesh is drawn is up to the scene objects that use it
 typedef struct {
-    vec3_t* vertices;   // dynamic array of vertices
-    face_t* faces;      // dynamic array of faces
-    vec3_t rotation;    // rotation of the mesh with x, y and z values
-    vec3_t scale;       // scale of x, y, and z components
-    vec3_t translation; // translation of x, y, and z components
+    vec3_t* vertices;               // dynamic array of vertices
+    tex2_t* texcoords;              // dynamic array of texture coordinates, one per vertex
+    vertex_stream_t vertex_stream;  // the same vertices as separate x, y and z streams for SIMD code
+    mesh_lod_t lods[MAX_MESH_LODS]; // levels of detail, from the full mesh down
+    int num_lods;
+    vec3_t bounds_min;  // axis-aligned bounding box of the vertices in model space
+    vec3_t bounds_max;
+    mapped_file_t cache_file;   // when loaded from a mesh cache the arrays point into this mapping
 } mesh_t;
 
-extern mesh_t mesh; // this stores mesh data
+//////////////////////////////////////////////
+// Functions for loading data into a mesh,  //
+// the mesh must be empty or zero-filled    //
+//////////////////////////////////////////////
+void load_cube_mesh_data(mesh_t* m);
+bool load_obj_file_data(mesh_t* m, char* filename);
+void free_mesh(mesh_t* m);
 
-/////////////////////////////////////////////////////
-// Functions for loading data into the mesh object //
-/////////////////////////////////////////////////////
-void load_cube_mesh_data(void);
-void load_obj_file_data(char* filename);
+void mesh_bounding_sphere(const mesh_t* m, vec3_t* center, float* radius);  // around the model-space bounding box
+bool is_mesh_outside_frustum(const mesh_t* m, const mat4_t* model_view_matrix);
+int select_mesh_lod(const mesh_t* m, const mat4_t* model_view_matrix, float pixels_per_unit, float max_pixel_error);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "mesh_cache.h"
+#include "mapped_file.h"
+#include "array.h"
+
+#define MESH_CACHE_ALIGNMENT 32     // every section starts on a whole AVX register
+
+static uint64_t align_up(uint64_t offset) {
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// The cache of foo.obj is foo.mesh in the same directory
+static bool mesh_cache_filename(const char* obj_filename, char* buffer, size_t size) {
+    size_t length = strlen(obj_filename);
+    if (length >= 4 && strcmp(obj_filename + length - 4, ".obj") == 0) {
+        length -= 4;
+    }
+    int written = snprintf(buffer, size, "%.*s.mesh", (int)length, obj_filename);
+    return written > 0 && (size_t)written < size;
+}
+
+// 64-bit FNV style hash that consumes eight bytes per step, fast enough to check a large OBJ file
+static uint64_t hash_bytes(const char* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ (uint8_t)data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static bool hash_file(const char* filename, uint64_t* hash) {
+    mapped_file_t file;
+    if (!map_file(filename, &file, false)) {
+        return false;
+    }
+    *hash = hash_bytes(file.data, file.size);
+    unmap_file(&file);
+    return true;
+}
+
+static bool is_section_inside(uint64_t offset, uint64_t size, size_t file_size) {
+    return offset <= file_size && size <= file_size - offset;
+}
+
+// A cache is stale when the OBJ changed size or, when only its modification time changed, its contents
+static bool is_mesh_cache_valid(const mapped_file_t* file, const char* obj_filename, const struct stat* obj_stat) {
+    if (file->size < sizeof(mesh_cache_header_t)) return false;
+
+    const mesh_cache_header_t* header = (const mesh_cache_header_t*)file->data;
+    if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION || header->face_size != sizeof(face_t)) {
+        return false;
+    }
+    if (header->num_vertices < 0 || header->num_lods < 1 || header->num_lods > MAX_MESH_LODS || header->stream_capacity < header->num_vertices) {
+        return false;
+    }
+    if (header->stream_capacity % VERTEX_STREAM_PADDING != 0 || header->stream_offset % VERTEX_STREAM_ALIGNMENT != 0) {
+        return false;
+    }
+
+    // Every array has to fit in the file together with the array.h header in front of it
+    if (header->vertices_offset < 2 * sizeof(int) || header->texcoords_offset < 2 * sizeof(int)) return false;
+    if (!is_section_inside(header->vertices_offset, (uint64_t)header->num_vertices * sizeof(vec3_t), file->size)) return false;
+    if (!is_section_inside(header->texcoords_offset, (uint64_t)header->num_vertices * sizeof(tex2_t), file->size)) return false;
+    if (!is_section_inside(header->stream_offset, (uint64_t)header->stream_capacity * 3 * sizeof(float), file->size)) return false;
+    for (int i = 0; i < header->num_lods; i++) {
+        const mesh_cache_lod_t* lod = &header->lods[i];
+        if (lod->num_faces < 0 || lod->num_clusters < 0 || lod->num_vertices < 0 || lod->num_vertices > header->num_vertices) return false;
+        if (lod->faces_offset < 2 * sizeof(int) || lod->clusters_offset < 2 * sizeof(int)) return false;
+        if (!is_section_inside(lod->faces_offset, (uint64_t)lod->num_faces * sizeof(face_t), file->size)) return false;
+        if (!is_section_inside(lod->clusters_offset, (uint64_t)lod->num_clusters * sizeof(cluster_t), file->size)) return false;
+    }
+
+    if (header->source_size != (uint64_t)obj_stat->st_size) return false;
+    if (header->source_mtime != (int64_t)obj_stat->st_mtime) {
+        // Touched or checked out again, the cache still holds if the bytes are the same
+        uint64_t hash;
+        if (!hash_file(obj_filename, &hash) || hash != header->source_hash) return false;
+    }
+    return true;
+}
+
+// Store the modification time of an OBJ that only passed the cache check by its hash, so the next
+// load takes the fast path again. A cache that cannot be written is still valid, it is hashed again.
+static void update_source_mtime(const char* cache_filename, int64_t source_mtime) {
+    FILE* file = fopen(cache_filename, "r+b");
+    if (file == NULL) return;
+    if (fseek(file, offsetof(mesh_cache_header_t, source_mtime), SEEK_SET) == 0) {
+        fwrite(&source_mtime, sizeof(source_mtime), 1, file);
+    }
+    fclose(file);
+}
+
+bool load_mesh_cache(const char* obj_filename, mesh_t* mesh) {
+    char cache_filename[1024];
+    if (!mesh_cache_filename(obj_filename, cache_filename, sizeof(cache_filename))) {
+        return false;
+    }
+
+    // A missing cache is not an error, it is written after the OBJ file is parsed
+    struct stat obj_stat, cache_stat;
+    if (stat(obj_filename, &obj_stat) != 0 || stat(cache_filename, &cache_stat) != 0) {
+        return false;
+    }
+
+    // Map copy-on-write, the mesh owns writable arrays but nothing is written back to the file
+    mapped_file_t file;
+    if (!map_file(cache_filename, &file, true)) {
+        return false;
+    }
+    if (!is_mesh_cache_valid(&file, obj_filename, &obj_stat)) {
+        unmap_file(&file);
+        return false;
+    }
+
+    const mesh_cache_header_t* header = (const mesh_cache_header_t*)file.data;
+    if (header->source_mtime != (int64_t)obj_stat.st_mtime) {
+        update_source_mtime(cache_filename, (int64_t)obj_stat.st_mtime);
+    }
+    mesh->vertices = (vec3_t*)(file.data + header->vertices_offset);
+    mesh->texcoords = (tex2_t*)(file.data + header->texcoords_offset);
+    bool is_consistent =
+        array_length(mesh->vertices) == header->num_vertices &&
+        array_length(mesh->texcoords) == header->num_vertices;
+    for (int i = 0; i < header->num_lods; i++) {
+        mesh_lod_t* lod = &mesh->lods[i];
+        lod->faces = (face_t*)(file.data + header->lods[i].faces_offset);
+        lod->clusters = (cluster_t*)(file.data + header->lods[i].clusters_offset);
+        lod->num_vertices = header->lods[i].num_vertices;
+        lod->error = header->lods[i].error;
+        is_consistent = is_consistent &&
+            array_length(lod->faces) == header->lods[i].num_faces &&
+            array_length(lod->clusters) == header->lods[i].num_clusters;
+    }
+    if (!is_consistent) {
+        mesh->vertices = NULL;
+        mesh->texcoords = NULL;
+        memset(mesh->lods, 0, sizeof(mesh->lods));
+        unmap_file(&file);
+        return false;
+    }
+    mesh->num_lods = header->num_lods;
+
+    float* streams = (float*)(file.data + header->stream_offset);
+    mesh->vertex_stream.x = streams;
+    mesh->vertex_stream.y = streams + header->stream_capacity;
+    mesh->vertex_stream.z = streams + 2 * header->stream_capacity;
+    mesh->vertex_stream.count = header->num_vertices;
+    mesh->vertex_stream.capacity = header->stream_capacity;
+    mesh->vertex_stream.block = NULL;
+
+    mesh->bounds_min = header->bounds_min;
+    mesh->bounds_max = header->bounds_max;
+    mesh->cache_file = file;
+    return true;
+}
+
+// Pad the file with zeros up to offset
+static bool write_padding(FILE* file, uint64_t* position, uint64_t offset) {
+    static const char zeros[MESH_CACHE_ALIGNMENT] = { 0 };
+    while (*position < offset) {
+        uint64_t size = offset - *position < MESH_CACHE_ALIGNMENT ? offset - *position : MESH_CACHE_ALIGNMENT;
+        if (fwrite(zeros, 1, size, file) != size) return false;
+        *position += size;
+    }
+    return true;
+}
+
+static bool write_bytes(FILE* file, uint64_t* position, const void* data, uint64_t size) {
+    if (size > 0 && fwrite(data, 1, size, file) != size) return false;
+    *position += size;
+    return true;
+}
+
+// Write the array.h header so the mapped array answers array_length
+static bool write_array(FILE* file, uint64_t* position, uint64_t offset, const void* data, int count, int item_size) {
+    int array_header[2] = { count, count };     // capacity and occupied
+    return
+        write_padding(file, position, offset - sizeof(array_header)) &&
+        write_bytes(file, position, array_header, sizeof(array_header)) &&
+        write_bytes(file, position, data, (uint64_t)count * item_size);
+}
+
+bool save_mesh_cache(const char* obj_filename, const mesh_t* mesh) {
+    char cache_filename[1024];
+    char temp_filename[1024 + 4];
+    if (!mesh_cache_filename(obj_filename, cache_filename, sizeof(cache_filename))) {
+        return false;
+    }
+    snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", cache_filename);
+
+    struct stat obj_stat;
+    mesh_cache_header_t header = { 0 };
+    if (stat(obj_filename, &obj_stat) != 0 || !hash_file(obj_filename, &header.source_hash)) {
+        return false;
+    }
+
+    int num_vertices = array_length(mesh->vertices);
+    int stream_capacity = mesh->vertex_stream.capacity;
+
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.face_size = sizeof(face_t);
+    header.num_vertices = num_vertices;
+    header.num_lods = mesh->num_lods;
+    header.stream_capacity = stream_capacity;
+    header.source_size = (uint64_t)obj_stat.st_size;
+    header.source_mtime = (int64_t)obj_stat.st_mtime;
+    header.bounds_min = mesh->bounds_min;
+    header.bounds_max = mesh->bounds_max;
+
+    // Sections start on aligned offsets, the array.h arrays leave room for their header in front
+    header.vertices_offset = align_up(sizeof(header)) + 2 * sizeof(int);
+    header.texcoords_offset = align_up(header.vertices_offset + (uint64_t)num_vertices * sizeof(vec3_t)) + 2 * sizeof(int);
+    header.stream_offset = align_up(header.texcoords_offset + (uint64_t)num_vertices * sizeof(tex2_t));
+    uint64_t end = header.stream_offset + (uint64_t)stream_capacity * 3 * sizeof(float);
+    for (int i = 0; i < mesh->num_lods; i++) {
+        mesh_cache_lod_t* lod = &header.lods[i];
+        lod->num_faces = array_length(mesh->lods[i].faces);
+        lod->num_clusters = array_length(mesh->lods[i].clusters);
+        lod->num_vertices = mesh->lods[i].num_vertices;
+        lod->error = mesh->lods[i].error;
+        lod->faces_offset = align_up(end) + 2 * sizeof(int);
+        lod->clusters_offset = align_up(lod->faces_offset + (uint64_t)lod->num_faces * sizeof(face_t)) + 2 * sizeof(int);
+        end = lod->clusters_offset + (uint64_t)lod->num_clusters * sizeof(cluster_t);
+    }
+
+    // Write to a temporary file and rename it, so a crash never leaves a truncated cache behind
+    FILE* file = fopen(temp_filename, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error writing the mesh cache %s.\n", cache_filename);
+        return false;
+    }
+    uint64_t position = 0;
+    const vertex_stream_t* stream = &mesh->vertex_stream;
+    bool is_written =
+        write_bytes(file, &position, &header, sizeof(header)) &&
+        write_array(file, &position, header.vertices_offset, mesh->vertices, num_vertices, sizeof(vec3_t)) &&
+        write_array(file, &position, header.texcoords_offset, mesh->texcoords, num_vertices, sizeof(tex2_t)) &&
+        write_padding(file, &position, header.stream_offset) &&
+        write_bytes(file, &position, stream->x, (uint64_t)stream_capacity * sizeof(float)) &&
+        write_bytes(file, &position, stream->y, (uint64_t)stream_capacity * sizeof(float)) &&
+        write_bytes(file, &position, stream->z, (uint64_t)stream_capacity * sizeof(float));
+    for (int i = 0; i < mesh->num_lods && is_written; i++) {
+        const mesh_cache_lod_t* lod = &header.lods[i];
+        is_written =
+            write_array(file, &position, lod->faces_offset, mesh->lods[i].faces, lod->num_faces, sizeof(face_t)) &&
+            write_array(file, &position, lod->clusters_offset, mesh->lods[i].clusters, lod->num_clusters, sizeof(cluster_t));
+    }
+    is_written = fclose(file) == 0 && is_written;
+
+    if (!is_written || rename(temp_filename, cache_filename) != 0) {
+        fprintf(stderr, "Error writing the mesh cache %s.\n", cache_filename);
+        remove(temp_filename);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "vector.h"
+#include "mesh.h"
+
+#define MESH_CACHE_MAGIC 0x4853454D     // "MESH" in little-endian byte order
+#define MESH_CACHE_VERSION 4            // bump whenever the layout or face_t changes
+
+///////////////////////////////////////////////////////////////////
+// Binary mesh written next to its OBJ file. The arrays are laid //
+// out exactly as they are in memory, each array.h array behind  //
+// its two int header and the vertex stream aligned for SIMD, so //
+// a mesh can point straight into the mapped file.               //
+///////////////////////////////////////////////////////////////////
+// Level of detail, its faces and clusters are sections of their own
+typedef struct {
+    int32_t num_faces;
+    int32_t num_clusters;
+    int32_t num_vertices;       // vertices from the start of the buffer the faces use
+    float error;
+    uint64_t faces_offset;
+    uint64_t clusters_offset;
+} mesh_cache_lod_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t face_size;         // sizeof(face_t) of the program that wrote the file
+    int32_t num_vertices;
+    int32_t num_lods;
+    int32_t stream_capacity;    // floats in each of the x, y and z streams
+    uint64_t source_size;       // OBJ file the cache was built from
+    int64_t source_mtime;
+    uint64_t source_hash;
+    vec3_t bounds_min;
+    vec3_t bounds_max;
+    uint64_t vertices_offset;   // byte offsets of the first element of every array
+    uint64_t texcoords_offset;
+    uint64_t stream_offset;
+    mesh_cache_lod_t lods[MAX_MESH_LODS];
+} mesh_cache_header_t;
+
+bool load_mesh_cache(const char* obj_filename, mesh_t* mesh);
+bool save_mesh_cache(const char* obj_filename, const mesh_t* mesh);
+
+#endif
@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "mesh_optimizer.h"
+
+static void face_indices(const face_t* face, int indices[3]) {
+    indices[0] = face->a;
+    indices[1] = face->b;
+    indices[2] = face->c;
+}
+
+// Transformed vertices per face with a FIFO cache, 3 when nothing is reused and 0.5 at best on a large grid
+float average_cache_miss_ratio(const face_t* faces, int num_faces, int num_vertices) {
+    if (num_faces <= 0) return 0.0f;
+
+    // A vertex is in the FIFO if fewer than VERTEX_CACHE_SIZE misses happened since it was inserted
+    int* inserted_at = (int*)malloc(sizeof(int) * num_vertices);
+    for (int i = 0; i < num_vertices; i++) inserted_at[i] = -VERTEX_CACHE_SIZE - 1;
+    int num_misses = 0;
+
+    for (int i = 0; i < num_faces; i++) {
+        int indices[3];
+        face_indices(&faces[i], indices);
+        for (int k = 0; k < 3; k++) {
+            int v = indices[k];
+            if (num_misses - inserted_at[v] > VERTEX_CACHE_SIZE) {
+                inserted_at[v] = num_misses;
+                num_misses++;
+            }
+        }
+    }
+
+    free(inserted_at);
+    return (float)num_misses / (float)num_faces;
+}
+
+//////////////////////////////////////////////////////////////////
+// Linear-speed vertex cache optimization after Tom Forsyth.    //
+// Every vertex gets a score from its position in a simulated   //
+// LRU cache and from how many faces still need it, the next    //
+// face is the one whose vertices score highest.                //
+//////////////////////////////////////////////////////////////////
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_FACE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+#define MAX_SCORED_VALENCE 64
+
+static float cache_position_scores[VERTEX_CACHE_SIZE];
+static float valence_scores[MAX_SCORED_VALENCE];
+
+static void init_score_tables(void) {
+    for (int i = 0; i < VERTEX_CACHE_SIZE; i++) {
+        // The three vertices of the face just added get a fixed score, so the order does not
+        // favour long thin strips that reuse only two of them
+        if (i < 3) {
+            cache_position_scores[i] = LAST_FACE_SCORE;
+        } else {
+            float scale = 1.0f / (VERTEX_CACHE_SIZE - 3);
+            cache_position_scores[i] = powf(1.0f - (i - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+    // Vertices with few faces left are boosted, so they get finished and leave the cache for good
+    valence_scores[0] = 0.0f;
+    for (int i = 1; i < MAX_SCORED_VALENCE; i++) {
+        valence_scores[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+    }
+}
+
+static float vertex_score(int cache_position, int num_active_faces) {
+    if (num_active_faces == 0) return -1.0f;
+
+    float score = cache_position >= 0 ? cache_position_scores[cache_position] : 0.0f;
+    int valence = num_active_faces < MAX_SCORED_VALENCE ? num_active_faces : MAX_SCORED_VALENCE - 1;
+    return score + valence_scores[valence];
+}
+
+void optimize_face_order(face_t* faces, int num_faces, int num_vertices) {
+    if (num_faces <= 0) return;
+    init_score_tables();
+
+    // Faces using every vertex, packed back to back, the first num_active_faces of a vertex are still unadded
+    int* adjacency_offsets = (int*)calloc(num_vertices + 1, sizeof(int));
+    int* adjacency = (int*)malloc(sizeof(int) * 3 * num_faces);
+    int* num_active_faces = (int*)calloc(num_vertices, sizeof(int));
+    for (int i = 0; i < num_faces; i++) {
+        int indices[3];
+        face_indices(&faces[i], indices);
+        for (int k = 0; k < 3; k++) num_active_faces[indices[k]]++;
+    }
+    for (int v = 0; v < num_vertices; v++) {
+        adjacency_offsets[v + 1] = adjacency_offsets[v] + num_active_faces[v];
+        num_active_faces[v] = 0;
+    }
+    for (int i = 0; i < num_faces; i++) {
+        int indices[3];
+        face_indices(&faces[i], indices);
+        for (int k = 0; k < 3; k++) {
+            int v = indices[k];
+            adjacency[adjacency_offsets[v] + num_active_faces[v]++] = i;
+        }
+    }
+
+    int* cache_positions = (int*)malloc(sizeof(int) * num_vertices);
+    float* vertex_scores = (float*)malloc(sizeof(float) * num_vertices);
+    for (int v = 0; v < num_vertices; v++) {
+        cache_positions[v] = -1;
+        vertex_scores[v] = vertex_score(-1, num_active_faces[v]);
+    }
+
+    float* face_scores = (float*)malloc(sizeof(float) * num_faces);
+    bool* is_added = (bool*)calloc(num_faces, sizeof(bool));
+    int best_face = 0;
+    for (int i = 0; i < num_faces; i++) {
+        int indices[3];
+        face_indices(&faces[i], indices);
+        face_scores[i] = vertex_scores[indices[0]] + vertex_scores[indices[1]] + vertex_scores[indices[2]];
+        if (face_scores[i] > face_scores[best_face]) best_face = i;
+    }
+
+    // The cache holds three extra entries while a face is added, those fall out at the end of the step
+    int cache[VERTEX_CACHE_SIZE + 3];
+    int cache_count = 0;
+    face_t* ordered_faces = (face_t*)malloc(sizeof(face_t) * num_faces);
+    int next_unadded = 0;
+
+    for (int n = 0; n < num_faces; n++) {
+        // No face touches the cache any more, continue with the next one in file order
+        if (best_face < 0) {
+            while (is_added[next_unadded]) next_unadded++;
+            best_face = next_unadded;
+        }
+
+        int indices[3];
+        face_indices(&faces[best_face], indices);
+        ordered_faces[n] = faces[best_face];
+        is_added[best_face] = true;
+
+        // Take the face off the active list of its vertices
+        for (int k = 0; k < 3; k++) {
+            int v = indices[k];
+            int* active = adjacency + adjacency_offsets[v];
+            for (int j = 0; j < num_active_faces[v]; j++) {
+                if (active[j] == best_face) {
+                    active[j] = active[num_active_faces[v] - 1];
+                    num_active_faces[v]--;
+                    break;
+                }
+            }
+        }
+
+        // Move its vertices to the front of the LRU cache
+        int new_cache[VERTEX_CACHE_SIZE + 3];
+        int new_count = 0;
+        for (int k = 0; k < 3; k++) {
+            bool is_repeated = false;
+            for (int j = 0; j < new_count; j++) is_repeated = is_repeated || new_cache[j] == indices[k];
+            if (!is_repeated) new_cache[new_count++] = indices[k];
+        }
+        for (int j = 0; j < cache_count; j++) {
+            int v = cache[j];
+            if (v != indices[0] && v != indices[1] && v != indices[2]) new_cache[new_count++] = v;
+        }
+
+        // Rescore the cached vertices, and the faces around them to find the next best one
+        for (int j = 0; j < new_count; j++) {
+            int v = new_cache[j];
+            cache_positions[v] = j < VERTEX_CACHE_SIZE ? j : -1;
+            vertex_scores[v] = vertex_score(cache_positions[v], num_active_faces[v]);
+        }
+        best_face = -1;
+        float best_score = -1.0f;
+        for (int j = 0; j < new_count; j++) {
+            int v = new_cache[j];
+            int* active = adjacency + adjacency_offsets[v];
+            for (int a = 0; a < num_active_faces[v]; a++) {
+                int f = active[a];
+                int face_vertices[3];
+                face_indices(&faces[f], face_vertices);
+                face_scores[f] = vertex_scores[face_vertices[0]] + vertex_scores[face_vertices[1]] + vertex_scores[face_vertices[2]];
+                if (face_scores[f] > best_score) {
+                    best_score = face_scores[f];
+                    best_face = f;
+                }
+            }
+        }
+
+        cache_count = new_count < VERTEX_CACHE_SIZE ? new_count : VERTEX_CACHE_SIZE;
+        memcpy(cache, new_cache, sizeof(int) * cache_count);
+    }
+
+    memcpy(faces, ordered_faces, sizeof(face_t) * num_faces);
+
+    free(ordered_faces);
+    free(is_added);
+    free(face_scores);
+    free(vertex_scores);
+    free(cache_positions);
+    free(num_active_faces);
+    free(adjacency);
+    free(adjacency_offsets);
+}
+
+// Store vertices in the order the faces first use them, so transforming and fetching them walks memory forward
+void reorder_vertices_by_first_use(face_t* faces, int num_faces, vec3_t* vertices, tex2_t* texcoords, int num_vertices) {
+    int* remap = (int*)malloc(sizeof(int) * num_vertices);
+    for (int v = 0; v < num_vertices; v++) remap[v] = -1;
+
+    int next_index = 0;
+    for (int i = 0; i < num_faces; i++) {
+        int* indices[3] = { &faces[i].a, &faces[i].b, &faces[i].c };
+        for (int k = 0; k < 3; k++) {
+            int v = *indices[k];
+            if (remap[v] < 0) remap[v] = next_index++;
+            *indices[k] = remap[v];
+        }
+    }
+    // Vertices no face uses keep their relative order at the end
+    for (int v = 0; v < num_vertices; v++) {
+        if (remap[v] < 0) remap[v] = next_index++;
+    }
+
+    vec3_t* old_vertices = (vec3_t*)malloc(sizeof(vec3_t) * num_vertices);
+    tex2_t* old_texcoords = (tex2_t*)malloc(sizeof(tex2_t) * num_vertices);
+    memcpy(old_vertices, vertices, sizeof(vec3_t) * num_vertices);
+    memcpy(old_texcoords, texcoords, sizeof(tex2_t) * num_vertices);
+    for (int v = 0; v < num_vertices; v++) {
+        vertices[remap[v]] = old_vertices[v];
+        texcoords[remap[v]] = old_texcoords[v];
+    }
+
+    free(old_texcoords);
+    free(old_vertices);
+    free(remap);
+}
@@ -0,0 +1,18 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "vector.h"
+#include "texture.h"
+#include "triangle.h"
+
+#define VERTEX_CACHE_SIZE 32    // entries of the post-transform cache faces are ordered for
+
+/////////////////////////////////////////////////////////////////
+// Load time passes that reorder an indexed mesh for locality, //
+// the set of faces and what they draw stays the same          //
+/////////////////////////////////////////////////////////////////
+float average_cache_miss_ratio(const face_t* faces, int num_faces, int num_vertices);
+void optimize_face_order(face_t* faces, int num_faces, int num_vertices);
+void reorder_vertices_by_first_use(face_t* faces, int num_faces, vec3_t* vertices, tex2_t* texcoords, int num_vertices);
+
+#endif
@@ -0,0 +1,441 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "mesh_simplifier.h"
+
+//////////////////////////////////////////////////////////////////
+// Sum of squared distances to a set of weighted planes, as the //
+// symmetric matrix A, the vector b and the constant c of       //
+// p'Ap + 2b'p + c. Doubles keep large flat sums from cancelling //
+//////////////////////////////////////////////////////////////////
+typedef struct {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+} quadric_t;
+
+static void quadric_add_plane(quadric_t* q, vec3_t normal, float d, float weight) {
+    double x = normal.x, y = normal.y, z = normal.z;
+    q->a00 += weight * x * x;
+    q->a01 += weight * x * y;
+    q->a02 += weight * x * z;
+    q->a11 += weight * y * y;
+    q->a12 += weight * y * z;
+    q->a22 += weight * z * z;
+    q->b0 += weight * d * x;
+    q->b1 += weight * d * y;
+    q->b2 += weight * d * z;
+    q->c += weight * d * d;
+    q->weight += weight;
+}
+
+static void quadric_add(quadric_t* q, const quadric_t* other) {
+    q->a00 += other->a00;
+    q->a01 += other->a01;
+    q->a02 += other->a02;
+    q->a11 += other->a11;
+    q->a12 += other->a12;
+    q->a22 += other->a22;
+    q->b0 += other->b0;
+    q->b1 += other->b1;
+    q->b2 += other->b2;
+    q->c += other->c;
+    q->weight += other->weight;
+}
+
+// Mean squared distance from p to the planes
+static float quadric_error(const quadric_t* q, vec3_t p) {
+    if (q->weight <= 0) return 0;
+    double x = p.x, y = p.y, z = p.z;
+    double error =
+        q->a00 * x * x + q->a11 * y * y + q->a22 * z * z +
+        2 * (q->a01 * x * y + q->a02 * x * z + q->a12 * y * z) +
+        2 * (q->b0 * x + q->b1 * y + q->b2 * z) +
+        q->c;
+    return error > 0 ? (float)(error / q->weight) : 0;
+}
+
+//////////////////////////////////////////////////////////////////
+// Vertices that share a position are wedges of the same corner //
+// with different texture coordinates. Every vertex points at   //
+// the first wedge of its position, and the wedges of a         //
+// position form a ring through next_wedge.                     //
+//////////////////////////////////////////////////////////////////
+static uint32_t hash_position(const vec3_t* p) {
+    uint32_t bits[3];
+    memcpy(bits, p, sizeof(bits));
+    uint32_t hash = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+
+    // Round coordinates leave the low mantissa bits zero, mix the high bits down before masking
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+static void build_position_groups(const vec3_t* vertices, int num_vertices, int* group, int* next_wedge) {
+    int capacity = 16;
+    while (capacity < 2 * num_vertices) capacity *= 2;
+    int* table = (int*)malloc(sizeof(int) * capacity);
+    for (int i = 0; i < capacity; i++) table[i] = -1;
+
+    for (int v = 0; v < num_vertices; v++) {
+        int slot = hash_position(&vertices[v]) & (capacity - 1);
+        while (table[slot] >= 0 && memcmp(&vertices[table[slot]], &vertices[v], sizeof(vec3_t)) != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] < 0) {
+            table[slot] = v;
+            group[v] = v;
+            next_wedge[v] = v;
+        } else {
+            int first = table[slot];
+            group[v] = first;
+            next_wedge[v] = next_wedge[first];
+            next_wedge[first] = v;
+        }
+    }
+    free(table);
+}
+
+// Faces around every vertex, packed back to back
+typedef struct {
+    int* offsets;   // the faces around vertex v are faces[offsets[v]] up to faces[offsets[v + 1]]
+    int* faces;
+} adjacency_t;
+
+static void build_adjacency(adjacency_t* adjacency, const face_t* faces, int num_faces, int num_vertices) {
+    // Count the faces of every vertex and sum them up so offsets[v] is where the faces of v end
+    int* offsets = adjacency->offsets;
+    memset(offsets, 0, sizeof(int) * (num_vertices + 1));
+    for (int i = 0; i < num_faces; i++) {
+        offsets[faces[i].a]++;
+        offsets[faces[i].b]++;
+        offsets[faces[i].c]++;
+    }
+    for (int v = 1; v < num_vertices; v++) offsets[v] += offsets[v - 1];
+    offsets[num_vertices] = 3 * num_faces;
+
+    // Filling every list from its end moves offsets[v] back to where it starts
+    for (int i = 0; i < num_faces; i++) {
+        adjacency->faces[--offsets[faces[i].a]] = i;
+        adjacency->faces[--offsets[faces[i].b]] = i;
+        adjacency->faces[--offsets[faces[i].c]] = i;
+    }
+}
+
+static bool has_directed_edge(const adjacency_t* adjacency, const face_t* faces, int from, int to) {
+    for (int i = adjacency->offsets[from]; i < adjacency->offsets[from + 1]; i++) {
+        const face_t* face = &faces[adjacency->faces[i]];
+        if ((face->a == from && face->b == to) || (face->b == from && face->c == to) || (face->c == from && face->a == to)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+enum {
+    VERTEX_MANIFOLD,    // moves onto any neighbour
+    VERTEX_BORDER,      // on one open border, moves along it
+    VERTEX_SEAM,        // one of two wedges on a UV seam, moves along it together with the other wedge
+    VERTEX_LOCKED       // corners, seams meeting, non-manifold spots, never moves
+};
+
+#define NO_EDGE -1
+#define MANY_EDGES -2
+
+// Open edges are the ones no face walks the other way, every vertex keeps the one it starts and the one it ends
+static void classify_vertices(const adjacency_t* adjacency, const face_t* faces, int num_faces, int num_vertices,
+                              const int* next_wedge, int* open_out, int* open_in, uint8_t* kinds) {
+    for (int v = 0; v < num_vertices; v++) {
+        open_out[v] = NO_EDGE;
+        open_in[v] = NO_EDGE;
+    }
+    for (int i = 0; i < num_faces; i++) {
+        int indices[3] = { faces[i].a, faces[i].b, faces[i].c };
+        for (int k = 0; k < 3; k++) {
+            int from = indices[k];
+            int to = indices[(k + 1) % 3];
+            if (has_directed_edge(adjacency, faces, to, from)) continue;
+            open_out[from] = open_out[from] == NO_EDGE ? to : MANY_EDGES;
+            open_in[to] = open_in[to] == NO_EDGE ? from : MANY_EDGES;
+        }
+    }
+
+    for (int v = 0; v < num_vertices; v++) {
+        int num_wedges = 1;
+        for (int w = next_wedge[v]; w != v; w = next_wedge[w]) num_wedges++;
+
+        if (open_out[v] == NO_EDGE && open_in[v] == NO_EDGE) {
+            kinds[v] = num_wedges == 1 ? VERTEX_MANIFOLD : VERTEX_LOCKED;
+        } else if (open_out[v] >= 0 && open_in[v] >= 0 && num_wedges <= 2) {
+            kinds[v] = num_wedges == 1 ? VERTEX_BORDER : VERTEX_SEAM;
+        } else {
+            kinds[v] = VERTEX_LOCKED;
+        }
+    }
+}
+
+// Planes of the faces around every position, plus planes standing on the open edges so borders and seams keep their shape
+static void build_quadrics(const vec3_t* vertices, const adjacency_t* adjacency, const face_t* faces, int num_faces,
+                           const int* group, quadric_t* quadrics) {
+    for (int i = 0; i < num_faces; i++) {
+        int indices[3] = { faces[i].a, faces[i].b, faces[i].c };
+        vec3_t a = vertices[indices[0]];
+        vec3_t normal = vec3_cross(vec3_sub(vertices[indices[1]], a), vec3_sub(vertices[indices[2]], a));
+        float length = vec3_length(normal);
+        if (length == 0) continue;
+        normal = vec3_div(normal, length);
+        float d = -vec3_dot(normal, a);
+        for (int k = 0; k < 3; k++) {
+            quadric_add_plane(&quadrics[group[indices[k]]], normal, d, length * 0.5f);
+        }
+
+        for (int k = 0; k < 3; k++) {
+            int from = indices[k];
+            int to = indices[(k + 1) % 3];
+            if (has_directed_edge(adjacency, faces, to, from)) continue;
+            vec3_t edge = vec3_sub(vertices[to], vertices[from]);
+            vec3_t edge_normal = vec3_cross(edge, normal);
+            float edge_length = vec3_length(edge_normal);
+            if (edge_length == 0) continue;
+            edge_normal = vec3_div(edge_normal, edge_length);
+            float edge_d = -vec3_dot(edge_normal, vertices[from]);
+            float weight = vec3_dot(edge, edge) * SIMPLIFY_BORDER_WEIGHT;
+            quadric_add_plane(&quadrics[group[from]], edge_normal, edge_d, weight);
+            quadric_add_plane(&quadrics[group[to]], edge_normal, edge_d, weight);
+        }
+    }
+}
+
+typedef struct {
+    int from;
+    int to;
+    float cost;
+} collapse_t;
+
+static int compare_collapses(const void* a, const void* b) {
+    float cost_a = ((const collapse_t*)a)->cost;
+    float cost_b = ((const collapse_t*)b)->cost;
+    return (cost_a > cost_b) - (cost_a < cost_b);
+}
+
+// Everything the passes share, indexed by vertex unless noted
+typedef struct {
+    const vec3_t* vertices;
+    face_t* faces;
+    int num_faces;
+    int* group;
+    int* next_wedge;
+    int* open_out;
+    int* open_in;
+    uint8_t* kinds;
+    int* remap;                 // where every vertex went in the current pass
+    bool* is_position_locked;   // indexed by group, positions a collapse of the current pass touched
+    quadric_t* quadrics;        // indexed by group
+    adjacency_t adjacency;
+} simplifier_t;
+
+static bool can_collapse(const simplifier_t* s, int from, int to) {
+    if (s->group[from] == s->group[to]) return false;
+    switch (s->kinds[from]) {
+    case VERTEX_MANIFOLD:
+        return true;
+    case VERTEX_BORDER:
+    case VERTEX_SEAM:
+        return to == s->open_out[from] || to == s->open_in[from];
+    default:
+        return false;
+    }
+}
+
+static float collapse_cost(const simplifier_t* s, int from, int to) {
+    quadric_t q = s->quadrics[s->group[from]];
+    quadric_add(&q, &s->quadrics[s->group[to]]);
+    return quadric_error(&q, s->vertices[to]);
+}
+
+// The other wedge of a seam vertex has to collapse onto the wedge of the same target position on its side
+static int seam_partner_target(const simplifier_t* s, int partner, int to) {
+    int out = s->open_out[partner];
+    int in = s->open_in[partner];
+    if (out >= 0 && s->group[out] == s->group[to]) return out;
+    if (in >= 0 && s->group[in] == s->group[to]) return in;
+    return -1;
+}
+
+// Check that moving from onto to turns none of the faces around it over, and count the faces that vanish
+static bool collapse_flips_faces(const simplifier_t* s, int from, int to, int* num_removed) {
+    const adjacency_t* adjacency = &s->adjacency;
+    for (int i = adjacency->offsets[from]; i < adjacency->offsets[from + 1]; i++) {
+        const face_t* face = &s->faces[adjacency->faces[i]];
+        int indices[3] = { s->remap[face->a], s->remap[face->b], s->remap[face->c] };
+        if (indices[0] == to || indices[1] == to || indices[2] == to) {
+            (*num_removed)++;
+            continue;
+        }
+
+        vec3_t before[3], after[3];
+        for (int k = 0; k < 3; k++) {
+            before[k] = s->vertices[indices[k]];
+            after[k] = indices[k] == from ? s->vertices[to] : before[k];
+        }
+        vec3_t normal_before = vec3_cross(vec3_sub(before[1], before[0]), vec3_sub(before[2], before[0]));
+        vec3_t normal_after = vec3_cross(vec3_sub(after[1], after[0]), vec3_sub(after[2], after[0]));
+        // A face that had no area to begin with has no side to turn over to
+        if (vec3_dot(normal_before, normal_before) == 0) continue;
+        if (vec3_dot(normal_before, normal_after) <= 0) return true;
+    }
+    return false;
+}
+
+// Find the seam partner of a collapse and check the faces, against the collapses made so far in this pass
+static bool plan_collapse(const simplifier_t* s, int from, int to, int* partner, int* partner_to, int* num_removed) {
+    *partner = -1;
+    *partner_to = -1;
+    *num_removed = 0;
+    if (s->kinds[from] == VERTEX_SEAM) {
+        *partner = s->next_wedge[from];
+        if (s->kinds[*partner] != VERTEX_SEAM) return false;
+        *partner_to = seam_partner_target(s, *partner, to);
+        if (*partner_to < 0) return false;
+    }
+    if (collapse_flips_faces(s, from, to, num_removed)) return false;
+    if (*partner >= 0 && collapse_flips_faces(s, *partner, *partner_to, num_removed)) return false;
+    return true;
+}
+
+// Every edge collapses in the cheaper of its two directions that is allowed, returns how many edges can collapse
+static int find_collapses(const simplifier_t* s, collapse_t* collapses) {
+    int num_collapses = 0;
+    for (int i = 0; i < s->num_faces; i++) {
+        int indices[3] = { s->faces[i].a, s->faces[i].b, s->faces[i].c };
+        for (int k = 0; k < 3; k++) {
+            int ends[2] = { indices[k], indices[(k + 1) % 3] };
+            // An edge shared by two faces is scored from the face where it runs from the lower index
+            if (ends[0] > ends[1] && has_directed_edge(&s->adjacency, s->faces, ends[1], ends[0])) continue;
+
+            collapse_t collapse = { .from = -1, .cost = INFINITY };
+            for (int e = 0; e < 2; e++) {
+                int from = ends[e];
+                int to = ends[1 - e];
+                int partner, partner_to, num_removed;
+                if (!can_collapse(s, from, to)) continue;
+                float cost = collapse_cost(s, from, to);
+                if (cost < collapse.cost && plan_collapse(s, from, to, &partner, &partner_to, &num_removed)) {
+                    collapse = (collapse_t){ from, to, cost };
+                }
+            }
+            if (collapse.from >= 0) collapses[num_collapses++] = collapse;
+        }
+    }
+    return num_collapses;
+}
+
+// Rewrite the faces through the remap and drop the ones that lost a corner
+static int remap_faces(face_t* faces, int num_faces, const int* remap) {
+    int count = 0;
+    for (int i = 0; i < num_faces; i++) {
+        face_t face = { remap[faces[i].a], remap[faces[i].b], remap[faces[i].c] };
+        if (face.a == face.b || face.b == face.c || face.c == face.a) continue;
+        faces[count++] = face;
+    }
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////
+// Collapses happen in passes. Each pass scores every edge with   //
+// the quadrics, sorts them and collapses the cheapest ones, with //
+// at most one collapse touching a position per pass so the       //
+// quadrics and adjacency stay valid until the faces are rebuilt. //
+////////////////////////////////////////////////////////////////////
+int simplify_faces(const vec3_t* vertices, int num_vertices, face_t* faces, int num_faces, int target_faces, float* error) {
+    *error = 0;
+    if (num_faces <= target_faces || num_faces <= 0) return num_faces;
+
+    simplifier_t s = {
+        .vertices = vertices,
+        .faces = faces,
+        .num_faces = num_faces,
+        .group = (int*)malloc(sizeof(int) * num_vertices),
+        .next_wedge = (int*)malloc(sizeof(int) * num_vertices),
+        .open_out = (int*)malloc(sizeof(int) * num_vertices),
+        .open_in = (int*)malloc(sizeof(int) * num_vertices),
+        .kinds = (uint8_t*)malloc(num_vertices),
+        .remap = (int*)malloc(sizeof(int) * num_vertices),
+        .is_position_locked = (bool*)malloc(num_vertices),
+        .quadrics = (quadric_t*)calloc(num_vertices, sizeof(quadric_t)),
+        .adjacency = {
+            .offsets = (int*)malloc(sizeof(int) * (num_vertices + 1)),
+            .faces = (int*)malloc(sizeof(int) * 3 * num_faces)
+        }
+    };
+    collapse_t* collapses = (collapse_t*)malloc(sizeof(collapse_t) * 3 * num_faces);
+
+    build_position_groups(vertices, num_vertices, s.group, s.next_wedge);
+    build_adjacency(&s.adjacency, faces, num_faces, num_vertices);
+    build_quadrics(vertices, &s.adjacency, faces, num_faces, s.group, s.quadrics);
+    float max_cost = 0;
+
+    while (s.num_faces > target_faces) {
+        build_adjacency(&s.adjacency, s.faces, s.num_faces, num_vertices);
+        classify_vertices(&s.adjacency, s.faces, s.num_faces, num_vertices, s.next_wedge, s.open_out, s.open_in, s.kinds);
+        for (int v = 0; v < num_vertices; v++) {
+            s.remap[v] = v;
+            s.is_position_locked[v] = false;
+        }
+
+        int num_collapses = find_collapses(&s, collapses);
+        if (num_collapses == 0) break;
+        qsort(collapses, num_collapses, sizeof(collapse_t), compare_collapses);
+
+        // Leave the collapses well above the cost of the ones this pass needs for the next pass, they
+        // may get cheaper or be replaced by better ones once the neighbourhood has changed
+        int goal = (s.num_faces - target_faces) / 2;
+        float cost_limit = collapses[goal < num_collapses ? goal : num_collapses - 1].cost * 1.5f;
+
+        int num_remaining = s.num_faces;
+        int num_collapsed = 0;
+        for (int i = 0; i < num_collapses && num_remaining > target_faces; i++) {
+            collapse_t* collapse = &collapses[i];
+            if (collapse->cost > cost_limit && num_collapsed > 0) break;
+
+            int from = collapse->from;
+            int to = collapse->to;
+            if (s.is_position_locked[s.group[from]] || s.is_position_locked[s.group[to]]) continue;
+
+            int partner, partner_to, num_removed;
+            if (!plan_collapse(&s, from, to, &partner, &partner_to, &num_removed)) continue;
+
+            s.remap[from] = to;
+            if (partner >= 0) s.remap[partner] = partner_to;
+            quadric_add(&s.quadrics[s.group[to]], &s.quadrics[s.group[from]]);
+            s.is_position_locked[s.group[from]] = true;
+            s.is_position_locked[s.group[to]] = true;
+            num_remaining -= num_removed;
+            num_collapsed++;
+            if (collapse->cost > max_cost) max_cost = collapse->cost;
+        }
+        if (num_collapsed == 0) break;
+
+        s.num_faces = remap_faces(s.faces, s.num_faces, s.remap);
+    }
+
+    *error = sqrtf(max_cost);
+
+    free(collapses);
+    free(s.adjacency.faces);
+    free(s.adjacency.offsets);
+    free(s.quadrics);
+    free(s.is_position_locked);
+    free(s.remap);
+    free(s.kinds);
+    free(s.open_in);
+    free(s.open_out);
+    free(s.next_wedge);
+    free(s.group);
+    return s.num_faces;
+}
@@ -0,0 +1,19 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include "vector.h"
+#include "triangle.h"
+
+#define SIMPLIFY_BORDER_WEIGHT 10.0f    // how much more moving off a border or UV seam costs than moving off a face
+
+////////////////////////////////////////////////////////////////////
+// Quadric error edge collapse after Garland and Heckbert. A      //
+// vertex only ever moves onto a neighbour, so the faces keep     //
+// indexing the same vertex buffer. Vertices that share their     //
+// position with another vertex sit on a UV seam, and a seam only //
+// shrinks along itself with both of its sides collapsed at once, //
+// the same way an open border does.                              //
+////////////////////////////////////////////////////////////////////
+int simplify_faces(const vec3_t* vertices, int num_vertices, face_t* faces, int num_faces, int target_faces, float* error);
+
+#endif
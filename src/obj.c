@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "obj.h"
+#include "mapped_file.h"
+#include "array.h"
+#include "thread_pool.h"
+
+///////////////////////////////////////////////////////////////
+// Tokenizer, every function takes the current position and  //
+// the end of the data and returns the position after what   //
+// it consumed. None of them ever reads past the end.        //
+///////////////////////////////////////////////////////////////
+static const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+static const char* skip_line(const char* p, const char* end) {
+    const char* newline = memchr(p, '\n', (size_t)(end - p));
+    return newline != NULL ? newline + 1 : end;
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool is_end_of_token(const char* p, const char* end) {
+    return p >= end || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n';
+}
+
+static const char* parse_int(const char* p, const char* end, int* value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    int result = 0;
+    while (p < end && is_digit(*p)) {
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+    *value = negative ? -result : result;
+    return p;
+}
+
+// Powers of ten that are exact in a double
+static const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static double scale_by_power_of_ten(double value, int exponent) {
+    // Multiplying or dividing by an exact power rounds once, so typical
+    // OBJ values come out the same as they would from strtod
+    while (exponent > 22) {
+        value *= 1e22;
+        exponent -= 22;
+    }
+    while (exponent < -22) {
+        value /= 1e22;
+        exponent += 22;
+    }
+    return exponent >= 0 ? value * POWERS_OF_TEN[exponent] : value / POWERS_OF_TEN[-exponent];
+}
+
+static const char* parse_float(const char* p, const char* end, float* value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    // Collect up to 19 significant digits, which always fit in 64 bits
+    uint64_t mantissa = 0;
+    int num_digits = 0;
+    int exponent = 0;
+    while (p < end && is_digit(*p)) {
+        if (num_digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            if (mantissa != 0) num_digits++;
+        } else {
+            exponent++;
+        }
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && is_digit(*p)) {
+            if (num_digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                if (mantissa != 0) num_digits++;
+                exponent--;
+            }
+            p++;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int exponent_value;
+        p = parse_int(p + 1, end, &exponent_value);
+        exponent += exponent_value;
+    }
+
+    double result = scale_by_power_of_ten((double)mantissa, exponent);
+    *value = (float)(negative ? -result : result);
+    return p;
+}
+
+// A chunk of the file is never smaller than this, so small files are parsed in one go
+#define OBJ_CHUNK_SIZE (1 << 20)
+
+// Corner of a face as read from a chunk, before its indices are rebased
+typedef struct {
+    int vertex;
+    int texcoord;               // -1 when the corner has no texture coordinates
+    bool is_vertex_relative;    // the index still needs the offset of the chunk added
+    bool is_texcoord_relative;
+} obj_corner_t;
+
+typedef struct {
+    obj_corner_t corners[3];
+} obj_triangle_t;
+
+/////////////////////////////////////////////////////////////////
+// Part of the file between two line boundaries, parsed on its //
+// own thread into buffers local to the chunk. The offsets say //
+// where those buffers land in the stitched arrays.            //
+/////////////////////////////////////////////////////////////////
+typedef struct {
+    const char* begin;
+    const char* end;
+    vec3_t* vertices;
+    tex2_t* texcoords;
+    obj_triangle_t* triangles;
+    int num_triangles;      // triangles left after the invalid ones are dropped
+    int vertex_offset;
+    int texcoord_offset;
+} obj_chunk_t;
+
+typedef struct {
+    obj_chunk_t* chunks;
+    vec3_t* positions;      // every v and vt line of the file, in order
+    tex2_t* texcoords;
+    int num_vertices;
+    int num_texcoords;
+} obj_loader_t;
+
+// OBJ indices are 1-based, negative ones count back from the last element read so far.
+// That element may live in an earlier chunk, so a negative index is kept relative to the
+// start of the chunk and flagged, to be rebased once the chunk offsets are known.
+static int chunk_index(int index, int local_count, bool* is_relative) {
+    *is_relative = index < 0;
+    if (index > 0) return index - 1;
+    if (index < 0) return local_count + index;
+    return -1;
+}
+
+// First pass, count the elements so every array is allocated once at its final size
+static void count_obj_elements(const char* p, const char* end, int* num_vertices, int* num_texcoords, int* num_triangles) {
+    *num_vertices = 0;
+    *num_texcoords = 0;
+    *num_triangles = 0;
+    while (p < end) {
+        p = skip_spaces(p, end);
+        if (end - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            (*num_vertices)++;
+        } else if (end - p >= 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+            (*num_texcoords)++;
+        } else if (end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            // A polygon with n corners becomes n - 2 triangles
+            int num_corners = 0;
+            p++;
+            while (true) {
+                p = skip_spaces(p, end);
+                if (p >= end || *p == '\n') break;
+                num_corners++;
+                while (!is_end_of_token(p, end)) p++;
+            }
+            if (num_corners >= 3) *num_triangles += num_corners - 2;
+        }
+        p = skip_line(p, end);
+    }
+}
+
+// Second pass, parse the lines we care about and ignore everything else
+static void parse_obj_chunk(int index, void* data) {
+    obj_loader_t* loader = (obj_loader_t*)data;
+    obj_chunk_t* chunk = &loader->chunks[index];
+    const char* p = chunk->begin;
+    const char* end = chunk->end;
+
+    int num_vertices, num_texcoords, num_triangles;
+    count_obj_elements(p, end, &num_vertices, &num_texcoords, &num_triangles);
+    chunk->vertices = array_reserve(NULL, num_vertices, sizeof(vec3_t));
+    chunk->texcoords = array_reserve(NULL, num_texcoords, sizeof(tex2_t));
+    chunk->triangles = array_reserve(NULL, num_triangles, sizeof(obj_triangle_t));
+
+    while (p < end) {
+        p = skip_spaces(p, end);
+
+        // If the current line has vertex information
+        if (end - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            vec3_t vertex;
+            p = parse_float(skip_spaces(p + 1, end), end, &vertex.x);
+            p = parse_float(skip_spaces(p, end), end, &vertex.y);
+            p = parse_float(skip_spaces(p, end), end, &vertex.z);
+            array_push(chunk->vertices, vertex);
+        }
+        // If the current line has texture coordinate information
+        else if (end - p >= 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+            tex2_t texcoord;
+            p = parse_float(skip_spaces(p + 2, end), end, &texcoord.u);
+            p = parse_float(skip_spaces(p, end), end, &texcoord.v);
+            array_push(chunk->texcoords, texcoord);
+        }
+        // If the current line has face information, the corners can be v, v/vt, v//vn or v/vt/vn
+        else if (end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            int vertex_count = array_length(chunk->vertices);
+            int texcoord_count = array_length(chunk->texcoords);
+            obj_corner_t first_corner, previous_corner;
+            int num_corners = 0;
+            p++;
+            while (true) {
+                p = skip_spaces(p, end);
+                if (p >= end || *p == '\n') break;
+
+                int vertex_index, texture_index = 0, normal_index;
+                p = parse_int(p, end, &vertex_index);
+                if (p < end && *p == '/') {
+                    p++;
+                    if (p < end && *p != '/') p = parse_int(p, end, &texture_index);
+                    if (p < end && *p == '/') p = parse_int(p + 1, end, &normal_index);
+                }
+                // Skip whatever is left of a malformed corner
+                while (!is_end_of_token(p, end)) p++;
+
+                obj_corner_t corner;
+                corner.vertex = chunk_index(vertex_index, vertex_count, &corner.is_vertex_relative);
+                corner.texcoord = chunk_index(texture_index, texcoord_count, &corner.is_texcoord_relative);
+
+                // Fan triangulate polygons around their first corner, this keeps the winding
+                if (num_corners == 0) {
+                    first_corner = corner;
+                } else if (num_corners >= 2) {
+                    obj_triangle_t triangle = { .corners = { first_corner, previous_corner, corner } };
+                    array_push(chunk->triangles, triangle);
+                }
+                previous_corner = corner;
+                num_corners++;
+            }
+        }
+        p = skip_line(p, end);
+    }
+}
+
+static bool is_valid_index(int index, int count) {
+    return index >= 0 && index < count;
+}
+
+// Copy the chunk vertices into place and turn its triangle indices into indices of the whole file
+static void rebase_obj_chunk(int index, void* data) {
+    obj_loader_t* loader = (obj_loader_t*)data;
+    obj_chunk_t* chunk = &loader->chunks[index];
+
+    memcpy(loader->positions + chunk->vertex_offset, chunk->vertices, sizeof(vec3_t) * array_length(chunk->vertices));
+    memcpy(loader->texcoords + chunk->texcoord_offset, chunk->texcoords, sizeof(tex2_t) * array_length(chunk->texcoords));
+
+    int num_triangles = array_length(chunk->triangles);
+    chunk->num_triangles = 0;
+    for (int i = 0; i < num_triangles; i++) {
+        obj_triangle_t triangle = chunk->triangles[i];
+        bool is_valid = true;
+        for (int k = 0; k < 3; k++) {
+            obj_corner_t* corner = &triangle.corners[k];
+            if (corner->is_vertex_relative) corner->vertex += chunk->vertex_offset;
+            if (corner->is_texcoord_relative) corner->texcoord += chunk->texcoord_offset;
+            if (!is_valid_index(corner->texcoord, loader->num_texcoords)) corner->texcoord = -1;
+            is_valid = is_valid && is_valid_index(corner->vertex, loader->num_vertices);
+        }
+        // A triangle pointing outside the vertex list cannot be drawn, compact the valid ones in place
+        if (is_valid) {
+            chunk->triangles[chunk->num_triangles++] = triangle;
+        }
+    }
+}
+
+// Key of a (position, texture coordinate) pair in the weld table, never 0 since vertex is never negative
+static uint64_t weld_key(int vertex, int texcoord) {
+    return ((uint64_t)(uint32_t)(vertex + 1) << 32) | (uint32_t)(texcoord + 1);
+}
+
+// Slot holding key, or the empty slot where it goes, in an open addressing table of mask + 1 slots
+static int weld_slot(const uint64_t* keys, int mask, uint64_t key) {
+    int slot = (int)((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    while (keys[slot] != 0 && keys[slot] != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Give every distinct (position, texture coordinate) pair used by a corner one vertex, and
+// turn the triangles into faces that index those vertices
+static void weld_obj_vertices(obj_loader_t* loader, int num_chunks, int num_triangles, obj_data_t* obj) {
+    int capacity = 16;
+    while (capacity < 2 * loader->num_vertices) capacity *= 2;
+    uint64_t* keys = (uint64_t*)calloc(capacity, sizeof(uint64_t));
+    int* values = (int*)malloc(sizeof(int) * capacity);
+    int num_welded = 0;
+
+    obj->vertices = array_reserve(NULL, loader->num_vertices, sizeof(vec3_t));
+    obj->texcoords = array_reserve(NULL, loader->num_vertices, sizeof(tex2_t));
+    obj->faces = array_hold(NULL, num_triangles, sizeof(face_t));
+
+    int face_index = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        obj_chunk_t* chunk = &loader->chunks[i];
+        for (int t = 0; t < chunk->num_triangles; t++) {
+            int indices[3];
+            for (int k = 0; k < 3; k++) {
+                obj_corner_t* corner = &chunk->triangles[t].corners[k];
+                uint64_t key = weld_key(corner->vertex, corner->texcoord);
+                int slot = weld_slot(keys, capacity - 1, key);
+                if (keys[slot] == 0) {
+                    // First time this pair shows up, it becomes a new vertex
+                    tex2_t uv = { 0, 0 };
+                    if (corner->texcoord >= 0) uv = loader->texcoords[corner->texcoord];
+                    array_push(obj->vertices, loader->positions[corner->vertex]);
+                    array_push(obj->texcoords, uv);
+                    keys[slot] = key;
+                    values[slot] = num_welded++;
+
+                    // Keep the table at most half full so probe sequences stay short
+                    if (2 * num_welded > capacity) {
+                        int new_capacity = capacity * 2;
+                        uint64_t* new_keys = (uint64_t*)calloc(new_capacity, sizeof(uint64_t));
+                        int* new_values = (int*)malloc(sizeof(int) * new_capacity);
+                        for (int s = 0; s < capacity; s++) {
+                            if (keys[s] == 0) continue;
+                            int new_slot = weld_slot(new_keys, new_capacity - 1, keys[s]);
+                            new_keys[new_slot] = keys[s];
+                            new_values[new_slot] = values[s];
+                        }
+                        free(keys);
+                        free(values);
+                        keys = new_keys;
+                        values = new_values;
+                        capacity = new_capacity;
+                        slot = weld_slot(keys, capacity - 1, key);
+                    }
+                }
+                indices[k] = values[slot];
+            }
+            face_t face = { .a = indices[0], .b = indices[1], .c = indices[2] };
+            obj->faces[face_index++] = face;
+        }
+    }
+
+    free(keys);
+    free(values);
+}
+
+bool obj_load(const char* filename, obj_data_t* obj) {
+    obj->vertices = NULL;
+    obj->texcoords = NULL;
+    obj->faces = NULL;
+
+    mapped_file_t file;
+    if (!map_file(filename, &file, false)) {
+        return false;
+    }
+
+    // Split the file into chunks that start right after a newline, so no line is cut in two
+    int num_chunks = (int)(file.size / OBJ_CHUNK_SIZE) + 1;
+    obj_chunk_t* chunks = (obj_chunk_t*)calloc(num_chunks, sizeof(obj_chunk_t));
+    const char* end = file.data + file.size;
+    const char* chunk_begin = file.data;
+    for (int i = 0; i < num_chunks; i++) {
+        const char* chunk_end = i == num_chunks - 1 ? end : file.data + file.size / num_chunks * (i + 1);
+        if (chunk_end < chunk_begin) chunk_end = chunk_begin;
+        if (chunk_end < end) chunk_end = skip_line(chunk_end, end);
+        chunks[i].begin = chunk_begin;
+        chunks[i].end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+
+    obj_loader_t loader = { .chunks = chunks };
+    thread_pool_run(parse_obj_chunk, &loader, num_chunks);
+
+    // Prefix sums of the chunk sizes give the offset of every chunk in the stitched arrays
+    for (int i = 0; i < num_chunks; i++) {
+        chunks[i].vertex_offset = loader.num_vertices;
+        chunks[i].texcoord_offset = loader.num_texcoords;
+        loader.num_vertices += array_length(chunks[i].vertices);
+        loader.num_texcoords += array_length(chunks[i].texcoords);
+    }
+    loader.positions = (vec3_t*)malloc(sizeof(vec3_t) * loader.num_vertices);
+    loader.texcoords = (tex2_t*)malloc(sizeof(tex2_t) * loader.num_texcoords);
+    thread_pool_run(rebase_obj_chunk, &loader, num_chunks);
+
+    int num_triangles = 0;
+    int num_skipped_triangles = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        num_triangles += chunks[i].num_triangles;
+        num_skipped_triangles += array_length(chunks[i].triangles) - chunks[i].num_triangles;
+    }
+    weld_obj_vertices(&loader, num_chunks, num_triangles, obj);
+
+    for (int i = 0; i < num_chunks; i++) {
+        array_free(chunks[i].vertices);
+        array_free(chunks[i].texcoords);
+        array_free(chunks[i].triangles);
+    }
+    free(chunks);
+    free(loader.positions);
+    free(loader.texcoords);
+    unmap_file(&file);
+
+    if (num_skipped_triangles > 0) {
+        fprintf(stderr, "Skipped %d triangles with invalid vertex indices in %s.\n", num_skipped_triangles, filename);
+    }
+    return true;
+}
+
+void obj_free(obj_data_t* obj) {
+    array_free(obj->vertices);
+    array_free(obj->texcoords);
+    array_free(obj->faces);
+    obj->vertices = NULL;
+    obj->texcoords = NULL;
+    obj->faces = NULL;
+}
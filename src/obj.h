@@ -0,0 +1,25 @@
+#ifndef OBJ_H
+#define OBJ_H
+
+#include <stdbool.h>
+#include "vector.h"
+#include "texture.h"
+#include "triangle.h"
+
+///////////////////////////////////////////////////////////////
+// Geometry read from an OBJ file, all dynamic arrays from   //
+// array.h. Polygons with more than three corners are fan    //
+// triangulated, so every face is a triangle. Corners that   //
+// share a position and texture coordinates are welded into  //
+// one vertex, texcoords runs parallel to vertices.          //
+///////////////////////////////////////////////////////////////
+typedef struct {
+    vec3_t* vertices;
+    tex2_t* texcoords;
+    face_t* faces;
+} obj_data_t;
+
+bool obj_load(const char* filename, obj_data_t* obj);
+void obj_free(obj_data_t* obj);
+
+#endif
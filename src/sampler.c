@@ -0,0 +1,227 @@
+#include <string.h>
+#include "sampler.h"
+#include "simd.h"
+
+// Texel coordinates are clamped to this range before they are converted to int
+#define TEXEL_COORDINATE_LIMIT 16777216.0f
+
+sampler_t texture_sampler = {
+    .address_u = ADDRESS_CLAMP,
+    .address_v = ADDRESS_CLAMP,
+    .filter = FILTER_BILINEAR
+};
+
+//////////////////////////////////////////////////////////////
+// Level of detail and texel addressing shared by all the   //
+// filters. The level of detail is in 8.8 fixed point, the  //
+// integer part picks the mip level and the fraction blends //
+// it with the next one for trilinear filtering.            //
+//////////////////////////////////////////////////////////////
+static int level_of_detail(float footprint_squared) {
+    if (!(footprint_squared > 1)) return 0;
+    if (footprint_squared > 1e30f) footprint_squared = 1e30f;
+
+    // Half of log2 of the squared footprint, the exponent gives the integer part
+    // and the top bits of the mantissa stand in for the fraction
+    uint32_t bits;
+    memcpy(&bits, &footprint_squared, sizeof(bits));
+    return ((int)(bits >> 15) - (127 << 8)) / 2;
+}
+
+static int address_texel(int x, int size, address_mode_t mode) {
+    switch (mode) {
+    case ADDRESS_WRAP:
+        x %= size;
+        return x < 0 ? x + size : x;
+    case ADDRESS_MIRROR: {
+        int period = 2 * size;
+        x %= period;
+        if (x < 0) x += period;
+        return x < size ? x : period - 1 - x;
+    }
+    default:
+        return x < 0 ? 0 : (x >= size ? size - 1 : x);
+    }
+}
+
+// Position in texels of a level, clamped with comparisons that also turn a NaN into the lower limit
+static float texel_coordinate(float t, int size) {
+    float x = t * size;
+    if (!(x > -TEXEL_COORDINATE_LIMIT)) return -TEXEL_COORDINATE_LIMIT;
+    return x < TEXEL_COORDINATE_LIMIT ? x : TEXEL_COORDINATE_LIMIT;
+}
+
+// Rounds down without a call to floorf, the coordinate is small enough to fit an int
+static int floor_to_int(float x) {
+    int i = (int)x;
+    return x < i ? i - 1 : i;
+}
+
+static uint32_t fetch_nearest(const texture_level_t* level, const sampler_t* sampler, float u, float v) {
+    int x = address_texel(floor_to_int(texel_coordinate(u, level->width)), level->width, sampler->address_u);
+    int y = address_texel(floor_to_int(texel_coordinate(v, level->height)), level->height, sampler->address_v);
+    return level->texels[TEXEL_INDEX(level, x, y)];
+}
+
+// The 2x2 texels around (u, v), top left, top right, bottom left and bottom right, and their
+// weights in 1/256 steps. The weights always add up to exactly 256.
+static void fetch_quad(const texture_level_t* level, const sampler_t* sampler, float u, float v, uint32_t* quad, int* weights) {
+    float x = texel_coordinate(u, level->width) - 0.5f;
+    float y = texel_coordinate(v, level->height) - 0.5f;
+    int x0 = floor_to_int(x);
+    int y0 = floor_to_int(y);
+    int fx = (int)((x - x0) * 256);
+    int fy = (int)((y - y0) * 256);
+    weights[3] = (fx * fy + 128) >> 8;
+    weights[1] = fx - weights[3];
+    weights[2] = fy - weights[3];
+    weights[0] = 256 - fx - fy + weights[3];
+
+    // A quad that does not cross a tile or the edge of the level sits at fixed offsets in one cache line,
+    // which is the case for 9 of the 16 positions in a tile
+    if ((unsigned)x0 < (unsigned)(level->width - 1) && (unsigned)y0 < (unsigned)(level->height - 1) && (x0 & 3) != 3 && (y0 & 3) != 3) {
+        const uint32_t* texels = &level->texels[TEXEL_INDEX(level, x0, y0)];
+        quad[0] = texels[0];
+        quad[1] = texels[1];
+        quad[2] = texels[TEXTURE_TILE_SIZE];
+        quad[3] = texels[TEXTURE_TILE_SIZE + 1];
+        return;
+    }
+
+    int x1 = address_texel(x0 + 1, level->width, sampler->address_u);
+    int y1 = address_texel(y0 + 1, level->height, sampler->address_v);
+    x0 = address_texel(x0, level->width, sampler->address_u);
+    y0 = address_texel(y0, level->height, sampler->address_v);
+    quad[0] = level->texels[TEXEL_INDEX(level, x0, y0)];
+    quad[1] = level->texels[TEXEL_INDEX(level, x1, y0)];
+    quad[2] = level->texels[TEXEL_INDEX(level, x0, y1)];
+    quad[3] = level->texels[TEXEL_INDEX(level, x1, y1)];
+}
+
+////////////////////////////////////////////////////////////////
+// Blend kernels. A channel times a weight is at most 255*256 //
+// and the weights add up to 256, so every sum fits in 16     //
+// bits with room left for the rounding term of 128.          //
+////////////////////////////////////////////////////////////////
+
+// Two channels at a time in the 16-bit halves of a 32-bit integer
+static uint32_t blend_quad_scalar(const uint32_t* quad, const int* weights) {
+    uint32_t even = 0x00800080;
+    uint32_t odd = 0x00800080;
+    for (int i = 0; i < 4; i++) {
+        even += (quad[i] & 0x00FF00FF) * (uint32_t)weights[i];
+        odd += ((quad[i] >> 8) & 0x00FF00FF) * (uint32_t)weights[i];
+    }
+    return ((even >> 8) & 0x00FF00FF) | (odd & 0xFF00FF00);
+}
+
+static uint32_t blend_quads_scalar(const uint32_t* quads, const int* weights, int t) {
+    uint32_t a = blend_quad_scalar(quads, weights);
+    uint32_t b = blend_quad_scalar(quads + 4, weights + 4);
+    uint32_t even = (a & 0x00FF00FF) * (uint32_t)(256 - t) + (b & 0x00FF00FF) * (uint32_t)t + 0x00800080;
+    uint32_t odd = ((a >> 8) & 0x00FF00FF) * (uint32_t)(256 - t) + ((b >> 8) & 0x00FF00FF) * (uint32_t)t + 0x00800080;
+    return ((even >> 8) & 0x00FF00FF) | (odd & 0xFF00FF00);
+}
+
+#ifdef SIMD_X86
+// Channels of the blended quad as 16-bit lanes in the low half of the register
+SIMD_TARGET_SSE2
+static __m128i blend_quad_epi16(const uint32_t* quad, const int* weights) {
+    __m128i texels = _mm_setr_epi32(quad[0], quad[1], quad[2], quad[3]);
+    __m128i top = _mm_unpacklo_epi8(texels, _mm_setzero_si128());
+    __m128i bottom = _mm_unpackhi_epi8(texels, _mm_setzero_si128());
+    __m128i packed_weights = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)weights), _mm_setzero_si128());
+    packed_weights = _mm_unpacklo_epi16(packed_weights, packed_weights);
+    __m128i top_weights = _mm_unpacklo_epi32(packed_weights, packed_weights);
+    __m128i bottom_weights = _mm_unpackhi_epi32(packed_weights, packed_weights);
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(top, top_weights), _mm_mullo_epi16(bottom, bottom_weights));
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+}
+
+SIMD_TARGET_SSE2
+static uint32_t blend_quad_sse2(const uint32_t* quad, const int* weights) {
+    __m128i channels = blend_quad_epi16(quad, weights);
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(channels, channels));
+}
+
+SIMD_TARGET_SSE2
+static uint32_t blend_quads_sse2(const uint32_t* quads, const int* weights, int t) {
+    __m128i a = _mm_mullo_epi16(blend_quad_epi16(quads, weights), _mm_set1_epi16(256 - t));
+    __m128i b = _mm_mullo_epi16(blend_quad_epi16(quads + 4, weights + 4), _mm_set1_epi16(t));
+    __m128i channels = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(a, b), _mm_set1_epi16(128)), 8);
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(channels, channels));
+}
+
+// Both quads at once, one mip level in each 128-bit lane
+SIMD_TARGET_AVX2
+static uint32_t blend_quads_avx2(const uint32_t* quads, const int* weights, int t) {
+    __m256i texels = _mm256_loadu_si256((const __m256i*)quads);
+    __m256i top = _mm256_unpacklo_epi8(texels, _mm256_setzero_si256());
+    __m256i bottom = _mm256_unpackhi_epi8(texels, _mm256_setzero_si256());
+    // Weights of the first quad in the low lane and of the second in the high lane, each repeated for the four channels
+    __m256i packed_weights = _mm256_packs_epi32(_mm256_loadu_si256((const __m256i*)weights), _mm256_setzero_si256());
+    packed_weights = _mm256_unpacklo_epi16(packed_weights, packed_weights);
+    __m256i top_weights = _mm256_unpacklo_epi32(packed_weights, packed_weights);
+    __m256i bottom_weights = _mm256_unpackhi_epi32(packed_weights, packed_weights);
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(top, top_weights), _mm256_mullo_epi16(bottom, bottom_weights));
+    sum = _mm256_add_epi16(sum, _mm256_srli_si256(sum, 8));
+    sum = _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(128)), 8);
+
+    // Weight the levels against each other and add the two lanes
+    __m256i level_weights = _mm256_setr_epi16(
+        256 - t, 256 - t, 256 - t, 256 - t, 0, 0, 0, 0,
+        t, t, t, t, 0, 0, 0, 0
+    );
+    sum = _mm256_mullo_epi16(sum, level_weights);
+    __m128i channels = _mm_add_epi16(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    channels = _mm_srli_epi16(_mm_add_epi16(channels, _mm_set1_epi16(128)), 8);
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(channels, channels));
+}
+#endif
+
+static uint32_t (*blend_quad)(const uint32_t*, const int*) = blend_quad_scalar;
+static uint32_t (*blend_quads)(const uint32_t*, const int*, int) = blend_quads_scalar;
+
+void init_sampler(void) {
+    blend_quad = blend_quad_scalar;
+    blend_quads = blend_quads_scalar;
+#ifdef SIMD_X86
+    // A bilinear sample only fills 128 bits, so it stays on SSE2 even when AVX2 is there
+    if (cpu_has_sse2()) {
+        blend_quad = blend_quad_sse2;
+        blend_quads = blend_quads_sse2;
+    }
+    if (cpu_has_avx2()) blend_quads = blend_quads_avx2;
+#endif
+}
+
+uint32_t sample_texture(const texture_t* texture, const sampler_t* sampler, float u, float v, float footprint_squared) {
+    int lod = level_of_detail(footprint_squared);
+    int last_level = texture->num_levels - 1;
+    int level = lod >> 8;
+    if (level >= last_level) {
+        level = last_level;
+        lod = level << 8;
+    }
+
+    switch (sampler->filter) {
+    case FILTER_NEAREST:
+        return fetch_nearest(&texture->levels[level], sampler, u, v);
+    case FILTER_BILINEAR: {
+        uint32_t quad[4];
+        int weights[4];
+        fetch_quad(&texture->levels[level], sampler, u, v, quad, weights);
+        return blend_quad(quad, weights);
+    }
+    default: {
+        uint32_t quads[8];
+        int weights[8];
+        fetch_quad(&texture->levels[level], sampler, u, v, quads, weights);
+        int t = lod & 255;
+        if (t == 0) return blend_quad(quads, weights);
+        fetch_quad(&texture->levels[level + 1], sampler, u, v, quads + 4, weights + 4);
+        return blend_quads(quads, weights, t);
+    }
+    }
+}
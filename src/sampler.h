@@ -0,0 +1,36 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+#include "texture.h"
+
+typedef enum {
+    ADDRESS_WRAP,       // repeat the texture
+    ADDRESS_CLAMP,      // repeat the edge texels
+    ADDRESS_MIRROR      // repeat the texture, every other copy mirrored
+} address_mode_t;
+
+typedef enum {
+    FILTER_NEAREST,     // nearest texel of the closest mip level
+    FILTER_BILINEAR,    // four texels of the closest mip level
+    FILTER_TRILINEAR    // four texels of each of the two closest mip levels
+} filter_mode_t;
+
+typedef struct {
+    address_mode_t address_u;
+    address_mode_t address_v;
+    filter_mode_t filter;
+} sampler_t;
+
+extern sampler_t texture_sampler;   // sampler used by the textured triangles
+
+//////////////////////////////////////////////////////////////////
+// Texels are blended per 8-bit channel with weights in 1/256   //
+// steps, the four texels of a bilinear sample in one SSE2      //
+// register and the eight of a trilinear sample in one AVX2     //
+// register. Every kernel gives the same result to the bit.     //
+//////////////////////////////////////////////////////////////////
+void init_sampler(void);    // picks the kernels for this CPU, call before any thread samples
+uint32_t sample_texture(const texture_t* texture, const sampler_t* sampler, float u, float v, float footprint_squared);  // footprint in texels of level 0
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include "scene.h"
+#include "array.h"
+#include "clipping.h"
+
+scene_t scene = {
+    .meshes = NULL,
+    .textures = NULL,
+    .objects = NULL,
+    .batches = NULL
+};
+
+int scene_add_mesh(scene_t* s, char* filename) {
+    // Load into a local mesh first, so a failed load leaves nothing behind in the scene
+    mesh_t mesh = { 0 };
+    if (!load_obj_file_data(&mesh, filename)) {
+        free_mesh(&mesh);
+        return -1;
+    }
+    array_push(s->meshes, mesh);
+    return array_length(s->meshes) - 1;
+}
+
+int scene_add_texture(scene_t* s, char* filename) {
+    texture_t texture;
+    if (!load_png_texture(&texture, filename)) {
+        return -1;
+    }
+    array_push(s->textures, texture);
+    return array_length(s->textures) - 1;
+}
+
+int scene_add_object(scene_t* s, int mesh_index, int texture_index) {
+    if (mesh_index < 0 || mesh_index >= array_length(s->meshes)) {
+        fprintf(stderr, "Error adding an object with the invalid mesh index %d.\n", mesh_index);
+        return -1;
+    }
+    if (texture_index >= array_length(s->textures)) {
+        texture_index = -1;
+    }
+
+    scene_object_t object = {
+        .mesh_index = mesh_index,
+        .texture_index = texture_index,
+        .color = 0xFFFFFFFF,
+        .rotation = { 0, 0, 0 },
+        .scale = { 1.0, 1.0, 1.0 },
+        .translation = { 0, 0, 0 },
+        .transform = { .is_valid = false }
+    };
+    array_push(s->objects, object);
+    return array_length(s->objects) - 1;
+}
+
+int scene_add_instance_batch(scene_t* s, int mesh_index, int texture_index) {
+    if (mesh_index < 0 || mesh_index >= array_length(s->meshes)) {
+        fprintf(stderr, "Error adding instances of the invalid mesh index %d.\n", mesh_index);
+        return -1;
+    }
+    if (texture_index >= array_length(s->textures)) {
+        texture_index = -1;
+    }
+
+    instance_batch_t batch = {
+        .mesh_index = mesh_index,
+        .texture_index = texture_index,
+        .instances = NULL
+    };
+    array_push(s->batches, batch);
+    return array_length(s->batches) - 1;
+}
+
+int scene_add_instance(scene_t* s, int batch_index, mat4_t world_matrix, uint32_t color) {
+    if (batch_index < 0 || batch_index >= array_length(s->batches)) {
+        return -1;
+    }
+    instance_batch_t* batch = &s->batches[batch_index];
+    mesh_instance_t instance = { .world_matrix = world_matrix, .color = color };
+    array_push(batch->instances, instance);
+    return array_length(batch->instances) - 1;
+}
+
+void free_scene(scene_t* s) {
+    for (int i = 0; i < array_length(s->meshes); i++) {
+        free_mesh(&s->meshes[i]);
+    }
+    for (int i = 0; i < array_length(s->textures); i++) {
+        free_texture(&s->textures[i]);
+    }
+    for (int i = 0; i < array_length(s->batches); i++) {
+        array_free(s->batches[i].instances);
+    }
+    array_free(s->meshes);
+    array_free(s->textures);
+    array_free(s->objects);
+    array_free(s->batches);
+    s->meshes = NULL;
+    s->textures = NULL;
+    s->objects = NULL;
+    s->batches = NULL;
+}
+
+static bool vec3_equal(vec3_t a, vec3_t b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+mat4_t* object_model_view_matrix(const scene_t* s, scene_object_t* object, const mat4_t* view_matrix) {
+    transform_cache_t* cache = &object->transform;
+
+    bool world_changed =
+        !cache->is_valid ||
+        !vec3_equal(cache->rotation, object->rotation) ||
+        !vec3_equal(cache->scale, object->scale) ||
+        !vec3_equal(cache->translation, object->translation);
+    bool view_changed = !cache->is_valid || memcmp(&cache->view_matrix, view_matrix, sizeof(mat4_t)) != 0;
+
+    if (world_changed) {
+        // Create a world matrix combining scale, rotation and translation matrices
+        mat4_t scale_matrix = mat4_make_scale(object->scale.x, object->scale.y, object->scale.z);
+        mat4_t rotation_matrix_x = mat4_make_rotation_x(object->rotation.x);
+        mat4_t rotation_matrix_y = mat4_make_rotation_y(object->rotation.y);
+        mat4_t rotation_matrix_z = mat4_make_rotation_z(object->rotation.z);
+        mat4_t translation_matrix = mat4_make_translation(object->translation.x, object->translation.y, object->translation.z);
+
+        cache->world_matrix = mat4_identity();
+        cache->world_matrix = mat4_mul_mat4(scale_matrix, cache->world_matrix);
+        cache->world_matrix = mat4_mul_mat4(rotation_matrix_z, cache->world_matrix);
+        cache->world_matrix = mat4_mul_mat4(rotation_matrix_y, cache->world_matrix);
+        cache->world_matrix = mat4_mul_mat4(rotation_matrix_x, cache->world_matrix);
+        cache->world_matrix = mat4_mul_mat4(translation_matrix, cache->world_matrix);
+
+        cache->rotation = object->rotation;
+        cache->scale = object->scale;
+        cache->translation = object->translation;
+
+        // Move the sphere around the model-space bounding box along with the object
+        vec3_t center;
+        float radius;
+        mesh_bounding_sphere(&s->meshes[object->mesh_index], &center, &radius);
+        object->bounds_center = vec3_from_vec4(mat4_mul_vec4(cache->world_matrix, vec4_from_vec3(center)));
+        object->bounds_radius = radius * mat4_max_scale(&cache->world_matrix);
+    }
+
+    if (world_changed || view_changed) {
+        // Fold the view matrix in so every vertex needs a single matrix-vector product
+        cache->model_view_matrix = mat4_mul_mat4(*view_matrix, cache->world_matrix);
+        cache->view_matrix = *view_matrix;
+    }
+
+    cache->is_valid = true;
+    return &cache->model_view_matrix;
+}
+
+// Test the world-space bounding sphere against the frustum, the view matrix is rigid so the radius stays the same
+bool is_object_outside_frustum(const scene_object_t* object, const mat4_t* view_matrix) {
+    vec3_t center = vec3_from_vec4(mat4_mul_vec4(*view_matrix, vec4_from_vec3(object->bounds_center)));
+    return is_sphere_outside_frustum(center, object->bounds_radius);
+}
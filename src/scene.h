@@ -0,0 +1,86 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "vector.h"
+#include "matrix.h"
+#include "mesh.h"
+#include "texture.h"
+
+/////////////////////////////////////////////////////////
+// Matrices of an object kept between frames, they are //
+// rebuilt only when its transform or the view change  //
+/////////////////////////////////////////////////////////
+typedef struct {
+    vec3_t rotation;            // transform the cached matrices were built from
+    vec3_t scale;
+    vec3_t translation;
+    mat4_t view_matrix;         // view matrix the model-view matrix was built with
+    mat4_t world_matrix;        // scale, rotation and translation combined
+    mat4_t model_view_matrix;   // world matrix followed by the view matrix
+    bool is_valid;
+} transform_cache_t;
+
+/////////////////////////////////////////////////////////////
+// One drawn copy of a mesh. Objects refer to the meshes   //
+// and textures of the scene by index, so any number of    //
+// objects can share one loaded asset.                     //
+/////////////////////////////////////////////////////////////
+typedef struct {
+    int mesh_index;
+    int texture_index;      // -1 when the object is not textured
+    uint32_t color;         // color of every face before lighting
+    vec3_t rotation;        // rotation of the object with x, y and z values
+    vec3_t scale;           // scale of x, y, and z components
+    vec3_t translation;     // translation of x, y, and z components
+    transform_cache_t transform;
+    vec3_t bounds_center;   // world-space bounding sphere, updated along with the world matrix
+    float bounds_radius;
+} scene_object_t;
+
+/////////////////////////////////////////////////////////////
+// Instances draw one mesh many times from nothing but a   //
+// matrix and a color each. The vertices, faces, levels of //
+// detail and clusters all come from the shared mesh, so   //
+// an instance costs less than an object.                  //
+/////////////////////////////////////////////////////////////
+typedef struct {
+    mat4_t world_matrix;
+    uint32_t color;         // color of every face before lighting
+} mesh_instance_t;
+
+typedef struct {
+    int mesh_index;
+    int texture_index;              // -1 when the instances are not textured
+    mesh_instance_t* instances;     // dynamic array of instances
+} instance_batch_t;
+
+typedef struct {
+    mesh_t* meshes;             // dynamic array of loaded meshes
+    texture_t* textures;        // dynamic array of loaded textures
+    scene_object_t* objects;    // dynamic array of objects, drawn in this order
+    instance_batch_t* batches;  // dynamic array of instanced meshes, drawn after the objects
+} scene_t;
+
+extern scene_t scene;
+
+////////////////////////////////////////////////////
+// Functions for filling the scene, the add       //
+// functions return the index of the new entry or //
+// -1 when it could not be loaded or added        //
+////////////////////////////////////////////////////
+int scene_add_mesh(scene_t* s, char* filename);
+int scene_add_texture(scene_t* s, char* filename);
+int scene_add_object(scene_t* s, int mesh_index, int texture_index);
+int scene_add_instance_batch(scene_t* s, int mesh_index, int texture_index);
+int scene_add_instance(scene_t* s, int batch_index, mat4_t world_matrix, uint32_t color);
+void free_scene(scene_t* s);
+
+/////////////////////////////////////////////////
+// Functions for the cached transform matrices //
+/////////////////////////////////////////////////
+mat4_t* object_model_view_matrix(const scene_t* s, scene_object_t* object, const mat4_t* view_matrix);  // rebuilds the cache first if it is stale
+bool is_object_outside_frustum(const scene_object_t* object, const mat4_t* view_matrix);
+
+#endif
@@ -0,0 +1,17 @@
+#include "simd.h"
+
+bool cpu_has_sse2(void) {
+#ifdef SIMD_X86
+    return __builtin_cpu_supports("sse2");
+#else
+    return false;
+#endif
+}
+
+bool cpu_has_avx2(void) {
+#ifdef SIMD_X86
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,20 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdbool.h>
+
+//////////////////////////////////////////////////////////////////
+// x86 SIMD kernels are compiled with per-function target       //
+// attributes and picked at runtime, other CPUs use scalar code //
+//////////////////////////////////////////////////////////////////
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SIMD_X86 1
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+bool cpu_has_sse2(void);
+bool cpu_has_avx2(void);
+
+#endif
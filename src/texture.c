@@ -1,11 +1,6 @@
+#include <stdlib.h>
 #include "texture.h"
 
-int texture_width = 64;
-int texture_height = 64;
-
-upng_t* png_texture = NULL;
-uint32_t* mesh_texture = NULL;
-
 const uint8_t REDBRICK_TEXTURE[] = {
     0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff,
     0x54, 0x54, 0x54, 0xff, 0x38, 0x38, 0x38, 0xff, 0x54, 0x54, 0x54, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x54, 0x54, 0x54, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x54, 0x54, 0x54, 0xff, 0x48, 0x48, 0x48, 0xff, 0x38, 0x38, 0x38, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x48, 0x48, 0x48, 0xff, 0x38, 0x38, 0x38, 0xff,
@@ -73,14 +68,114 @@ const uint8_t REDBRICK_TEXTURE[] = {
     0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff,
 };
 
-void load_png_texture_data(char* filename) {
-    png_texture = upng_new_from_file(filename);
-    if (png_texture != NULL) {
-        upng_decode(png_texture);
-        if (upng_get_error(png_texture) == UPNG_EOK) {
-            mesh_texture = (uint32_t*)upng_get_buffer(png_texture);
-            texture_width = upng_get_width(png_texture);
-            texture_height = upng_get_height(png_texture);
+bool load_png_texture(texture_t* texture, const char* filename) {
+    texture->num_levels = 0;
+    texture->block = NULL;
+    upng_t* png = upng_new_from_file(filename);
+    if (png == NULL) {
+        fprintf(stderr, "Error opening the texture %s.\n", filename);
+        return false;
+    }
+    upng_decode(png);
+    if (upng_get_error(png) != UPNG_EOK) {
+        fprintf(stderr, "Error decoding the texture %s.\n", filename);
+        upng_free(png);
+        return false;
+    }
+    if (upng_get_format(png) != UPNG_RGBA8) {
+        fprintf(stderr, "Error loading the texture %s, only 8-bit RGBA is supported.\n", filename);
+        upng_free(png);
+        return false;
+    }
+
+    // The texture keeps its own tiled copy, the decoded image is not needed after that
+    create_texture(texture, (const uint32_t*)upng_get_buffer(png), upng_get_width(png), upng_get_height(png));
+    upng_free(png);
+    return true;
+}
+
+// Average of four pixels per 8-bit channel, rounded, two channels at a time in 16-bit lanes
+static uint32_t average_pixels(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    uint32_t even = (a & 0x00FF00FF) + (b & 0x00FF00FF) + (c & 0x00FF00FF) + (d & 0x00FF00FF) + 0x00020002;
+    uint32_t odd = ((a >> 8) & 0x00FF00FF) + ((b >> 8) & 0x00FF00FF) + ((c >> 8) & 0x00FF00FF) + ((d >> 8) & 0x00FF00FF) + 0x00020002;
+    return ((even >> 2) & 0x00FF00FF) | (((odd >> 2) & 0x00FF00FF) << 8);
+}
+
+// Box filter a row-major level down to half its size, an odd size repeats the last row or column
+static void downsample_pixels(const uint32_t* source, int source_width, int source_height, uint32_t* pixels, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        const uint32_t* row0 = source + source_width * (2 * y);
+        const uint32_t* row1 = source + source_width * (2 * y + 1 < source_height ? 2 * y + 1 : 2 * y);
+        for (int x = 0; x < width; x++) {
+            int x0 = 2 * x;
+            int x1 = x0 + 1 < source_width ? x0 + 1 : x0;
+            pixels[width * y + x] = average_pixels(row0[x0], row0[x1], row1[x0], row1[x1]);
+        }
+    }
+}
+
+// Copy a row-major level into tiles, the texels that pad the last tiles repeat the edge of the level
+static void tile_pixels(const uint32_t* pixels, texture_level_t* level) {
+    int tiles_per_column = (level->height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+    for (int y = 0; y < tiles_per_column * TEXTURE_TILE_SIZE; y++) {
+        const uint32_t* row = pixels + level->width * (y < level->height ? y : level->height - 1);
+        for (int x = 0; x < level->tiles_per_row * TEXTURE_TILE_SIZE; x++) {
+            level->texels[TEXEL_INDEX(level, x, y)] = row[x < level->width ? x : level->width - 1];
+        }
+    }
+}
+
+bool create_texture(texture_t* texture, const uint32_t* pixels, int width, int height) {
+    texture->num_levels = 0;
+    texture->block = NULL;
+    if (width <= 0 || height <= 0) return false;
+
+    // Every level halves the one before it down to 1x1, count the texels of their tiles and of the plain mips
+    texture_level_t* levels = texture->levels;
+    int num_texels = 0;
+    int num_mip_pixels = 0;
+    int num_levels = 0;
+    while (num_levels < MAX_TEXTURE_LEVELS) {
+        texture_level_t* level = &levels[num_levels];
+        level->width = num_levels == 0 ? width : (levels[num_levels - 1].width > 1 ? levels[num_levels - 1].width / 2 : 1);
+        level->height = num_levels == 0 ? height : (levels[num_levels - 1].height > 1 ? levels[num_levels - 1].height / 2 : 1);
+        // An odd number of tiles per row keeps a column of tiles from falling into the same cache sets
+        level->tiles_per_row = ((level->width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE) | 1;
+        int tiles_per_column = (level->height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        num_texels += level->tiles_per_row * tiles_per_column * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+        if (num_levels > 0) num_mip_pixels += level->width * level->height;
+        num_levels++;
+        if (level->width == 1 && level->height == 1) break;
+    }
+
+    void* block = malloc(sizeof(uint32_t) * num_texels + TEXTURE_ALIGNMENT);
+    uint32_t* texels = (uint32_t*)(((uintptr_t)block + TEXTURE_ALIGNMENT - 1) & ~(uintptr_t)(TEXTURE_ALIGNMENT - 1));
+    uint32_t* mip_pixels = (uint32_t*)malloc(sizeof(uint32_t) * (num_mip_pixels > 0 ? num_mip_pixels : 1));
+
+    // Box filter the plain mips from level 0 down, then tile every level
+    const uint32_t* level_pixels = pixels;
+    uint32_t* next_pixels = mip_pixels;
+    for (int i = 0; i < num_levels; i++) {
+        texture_level_t* level = &levels[i];
+        if (i > 0) {
+            const texture_level_t* source = &levels[i - 1];
+            downsample_pixels(level_pixels, source->width, source->height, next_pixels, level->width, level->height);
+            level_pixels = next_pixels;
+            next_pixels += level->width * level->height;
         }
+        level->texels = texels;
+        texels += level->tiles_per_row * ((level->height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+        tile_pixels(level_pixels, level);
     }
-}
\ No newline at end of file
+
+    free(mip_pixels);
+    texture->block = block;
+    texture->num_levels = num_levels;
+    return true;
+}
+
+void free_texture(texture_t* texture) {
+    free(texture->block);
+    texture->block = NULL;
+    texture->num_levels = 0;
+}
@@ -2,6 +2,7 @@
 #define TEXTURE_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "upng.h"
 #include <stdio.h>
 
@@ -10,14 +11,41 @@ typedef struct {
     float v;
 } tex2_t;
 
-extern int texture_width;
-extern int texture_height;
+#define MAX_TEXTURE_LEVELS 16     // enough for a 32768x32768 texture
+#define TEXTURE_TILE_SIZE 4       // a 4x4 tile of 32-bit texels fills one 64-byte cache line
+#define TEXTURE_ALIGNMENT 64
 
-extern const uint8_t REDBRICK_TEXTURE[];
+///////////////////////////////////////////////////////////////
+// Texels are stored in 4x4 tiles, the tiles row by row and  //
+// the texels of a tile row by row. Nearby texels then share //
+// a cache line in any direction, not only along a row. The  //
+// padding that fills the last tiles repeats the edge texel. //
+///////////////////////////////////////////////////////////////
+typedef struct {
+    uint32_t* texels;
+    int width;
+    int height;
+    int tiles_per_row;
+} texture_level_t;
+
+// Index of texel (x, y) in the texels of a level, the tile size of 4 is built into the shifts
+#define TEXEL_INDEX(level, x, y) \
+    (((((y) >> 2) * (level)->tiles_per_row + ((x) >> 2)) << 4) | (((y) & 3) << 2) | ((x) & 3))
 
-extern upng_t* png_texture;
-extern uint32_t* mesh_texture;
+///////////////////////////////////////////////////////////
+// Texture with its mip chain, every level halves the    //
+// one before it down to 1x1, all in a single allocation //
+///////////////////////////////////////////////////////////
+typedef struct {
+    texture_level_t levels[MAX_TEXTURE_LEVELS];
+    int num_levels;
+    void* block;
+} texture_t;
+
+extern const uint8_t REDBRICK_TEXTURE[];
 
-void load_png_texture_data(char* filename);
+bool load_png_texture(texture_t* texture, const char* filename);
+bool create_texture(texture_t* texture, const uint32_t* pixels, int width, int height);  // from row-major pixels
+void free_texture(texture_t* texture);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "thread_pool.h"
+
+static pthread_t workers[MAX_WORKER_THREADS];
+static int num_workers = 0;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_available = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_finished = PTHREAD_COND_INITIALIZER;
+
+// State of the batch of jobs currently running, protected by the mutex
+static thread_pool_job_t current_job = NULL;
+static void* current_data = NULL;
+static int job_count = 0;
+static int next_index = 0;
+static int finished_count = 0;
+static int generation = 0;
+static bool is_shutting_down = false;
+
+// Take job indices until there are none left, must be called with the mutex locked
+static void run_pending_jobs(void) {
+    while (next_index < job_count) {
+        int index = next_index++;
+
+        pthread_mutex_unlock(&mutex);
+        current_job(index, current_data);
+        pthread_mutex_lock(&mutex);
+
+        finished_count++;
+        if (finished_count == job_count) {
+            pthread_cond_broadcast(&work_finished);
+        }
+    }
+}
+
+static void* worker_main(void* arg) {
+    int seen_generation = 0;
+
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        // Sleep until a new batch of jobs is submitted
+        while (generation == seen_generation && !is_shutting_down) {
+            pthread_cond_wait(&work_available, &mutex);
+        }
+        if (is_shutting_down) break;
+
+        seen_generation = generation;
+        run_pending_jobs();
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return NULL;
+}
+
+bool thread_pool_init(int num_threads) {
+    if (num_threads <= 0) {
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_threads > MAX_WORKER_THREADS + 1) {
+        num_threads = MAX_WORKER_THREADS + 1;
+    }
+
+    // The thread calling thread_pool_run also works, so it needs one less worker
+    for (int i = 0; i < num_threads - 1; i++) {
+        if (pthread_create(&workers[num_workers], NULL, worker_main, NULL) != 0) {
+            fprintf(stderr, "Error creating worker thread.\n");
+            return false;
+        }
+        num_workers++;
+    }
+    return true;
+}
+
+int thread_pool_num_threads(void) {
+    return num_workers + 1;
+}
+
+// Run job for every index and block until all of them have finished
+void thread_pool_run(thread_pool_job_t job, void* data, int count) {
+    if (count <= 0) return;
+
+    pthread_mutex_lock(&mutex);
+    current_job = job;
+    current_data = data;
+    job_count = count;
+    next_index = 0;
+    finished_count = 0;
+    generation++;
+    pthread_cond_broadcast(&work_available);
+
+    run_pending_jobs();
+    while (finished_count < job_count) {
+        pthread_cond_wait(&work_finished, &mutex);
+    }
+
+    current_job = NULL;
+    current_data = NULL;
+    job_count = 0;
+    pthread_mutex_unlock(&mutex);
+}
+
+void thread_pool_destroy(void) {
+    pthread_mutex_lock(&mutex);
+    is_shutting_down = true;
+    pthread_cond_broadcast(&work_available);
+    pthread_mutex_unlock(&mutex);
+
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    num_workers = 0;
+    is_shutting_down = false;
+}
@@ -0,0 +1,19 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdbool.h>
+
+#define MAX_WORKER_THREADS 64
+
+// A job is called once for every index in [0, count) of a thread_pool_run call
+typedef void (*thread_pool_job_t)(int index, void* data);
+
+///////////////////////////////////////////////////////////////
+// Pool of worker threads shared by the renderer and loaders //
+///////////////////////////////////////////////////////////////
+bool thread_pool_init(int num_threads);     // num_threads <= 0 uses one thread per core
+int thread_pool_num_threads(void);          // worker threads plus the calling thread
+void thread_pool_run(thread_pool_job_t job, void* data, int count);
+void thread_pool_destroy(void);
+
+#endif
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "tile.h"
+#include "thread_pool.h"
+
+// Extra pixels around a triangle's bounds to cover the vertex markers drawn on top of it
+#define TILE_BIN_MARGIN 3
+
+static int num_tiles_x = 0;
+static int num_tiles_y = 0;
+static int tiles_width = 0;
+static int tiles_height = 0;
+
+// Triangle indices of all bins stored back to back, tile t owns [tile_offsets[t], tile_offsets[t + 1])
+static int* tile_offsets = NULL;
+static int* tile_triangle_indices = NULL;
+static int tile_triangle_indices_capacity = 0;
+
+static triangle_t* binned_triangles = NULL;
+static tile_draw_func_t tile_draw_func = NULL;
+
+bool init_tiles(int screen_width, int screen_height) {
+    tiles_width = screen_width;
+    tiles_height = screen_height;
+    num_tiles_x = (screen_width + TILE_SIZE - 1) / TILE_SIZE;
+    num_tiles_y = (screen_height + TILE_SIZE - 1) / TILE_SIZE;
+    tile_offsets = (int*)calloc(num_tiles_x * num_tiles_y + 1, sizeof(int));
+    if (tile_offsets == NULL) {
+        fprintf(stderr, "Error allocating the screen tiles.\n");
+        return false;
+    }
+    return true;
+}
+
+// Find the range of tiles touched by the triangle, returns false if it is off the screen
+static bool triangle_tile_range(triangle_t* triangle, int* min_tx, int* min_ty, int* max_tx, int* max_ty) {
+    float min_x = triangle->points[0].x, max_x = min_x;
+    float min_y = triangle->points[0].y, max_y = min_y;
+    for (int i = 1; i < 3; i++) {
+        if (triangle->points[i].x < min_x) min_x = triangle->points[i].x;
+        if (triangle->points[i].x > max_x) max_x = triangle->points[i].x;
+        if (triangle->points[i].y < min_y) min_y = triangle->points[i].y;
+        if (triangle->points[i].y > max_y) max_y = triangle->points[i].y;
+    }
+
+    // Triangles that are NaN or entirely off the screen are not binned at all
+    if (!(max_x >= -TILE_BIN_MARGIN && min_x <= tiles_width + TILE_BIN_MARGIN &&
+          max_y >= -TILE_BIN_MARGIN && min_y <= tiles_height + TILE_BIN_MARGIN)) {
+        return false;
+    }
+
+    int x0 = (int)floor(min_x) - TILE_BIN_MARGIN;
+    int y0 = (int)floor(min_y) - TILE_BIN_MARGIN;
+    int x1 = (int)ceil(max_x) + TILE_BIN_MARGIN;
+    int y1 = (int)ceil(max_y) + TILE_BIN_MARGIN;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > tiles_width - 1) x1 = tiles_width - 1;
+    if (y1 > tiles_height - 1) y1 = tiles_height - 1;
+
+    *min_tx = x0 / TILE_SIZE;
+    *min_ty = y0 / TILE_SIZE;
+    *max_tx = x1 / TILE_SIZE;
+    *max_ty = y1 / TILE_SIZE;
+    return true;
+}
+
+// Sort the triangles into the bins of the tiles they overlap, keeping their original order in each bin
+bool bin_triangles_into_tiles(triangle_t* triangles, int num_triangles) {
+    int num_tiles = num_tiles_x * num_tiles_y;
+    int min_tx, min_ty, max_tx, max_ty;
+    if (tile_offsets == NULL) return false;
+
+    // Count how many triangles land in each tile
+    for (int t = 0; t <= num_tiles; t++) {
+        tile_offsets[t] = 0;
+    }
+    for (int i = 0; i < num_triangles; i++) {
+        if (!triangle_tile_range(&triangles[i], &min_tx, &min_ty, &max_tx, &max_ty)) continue;
+        for (int ty = min_ty; ty <= max_ty; ty++) {
+            for (int tx = min_tx; tx <= max_tx; tx++) {
+                tile_offsets[(ty * num_tiles_x) + tx + 1]++;
+            }
+        }
+    }
+
+    // Prefix sum of the counts gives the start of every bin
+    for (int t = 0; t < num_tiles; t++) {
+        tile_offsets[t + 1] += tile_offsets[t];
+    }
+    int total = tile_offsets[num_tiles];
+    if (total > tile_triangle_indices_capacity) {
+        // Keep the old bins when they cannot grow, they are freed along with the tiles
+        int* indices = (int*)realloc(tile_triangle_indices, sizeof(int) * (size_t)total * 2);
+        if (indices == NULL) {
+            fprintf(stderr, "Error allocating the bins of %d triangles.\n", num_triangles);
+            return false;
+        }
+        tile_triangle_indices = indices;
+        tile_triangle_indices_capacity = total * 2;
+    }
+
+    // Fill the bins using each bin start as its write cursor, which leaves it at the start of the next bin
+    for (int i = 0; i < num_triangles; i++) {
+        if (!triangle_tile_range(&triangles[i], &min_tx, &min_ty, &max_tx, &max_ty)) continue;
+        for (int ty = min_ty; ty <= max_ty; ty++) {
+            for (int tx = min_tx; tx <= max_tx; tx++) {
+                int tile = (ty * num_tiles_x) + tx;
+                tile_triangle_indices[tile_offsets[tile]++] = i;
+            }
+        }
+    }
+    // Shift the cursors back so every bin starts where the previous one ends
+    for (int t = num_tiles; t > 0; t--) {
+        tile_offsets[t] = tile_offsets[t - 1];
+    }
+    tile_offsets[0] = 0;
+
+    binned_triangles = triangles;
+    return true;
+}
+
+static void render_tile(int tile, void* data) {
+    int tile_x = (tile % num_tiles_x) * TILE_SIZE;
+    int tile_y = (tile / num_tiles_x) * TILE_SIZE;
+
+    rect_t tile_rect = {
+        .min_x = tile_x,
+        .min_y = tile_y,
+        .max_x = tile_x + TILE_SIZE - 1 < tiles_width - 1 ? tile_x + TILE_SIZE - 1 : tiles_width - 1,
+        .max_y = tile_y + TILE_SIZE - 1 < tiles_height - 1 ? tile_y + TILE_SIZE - 1 : tiles_height - 1
+    };
+
+    for (int i = tile_offsets[tile]; i < tile_offsets[tile + 1]; i++) {
+        tile_draw_func(&binned_triangles[tile_triangle_indices[i]], tile_rect);
+    }
+}
+
+// Draw the binned triangles of every tile on the thread pool
+void render_tiles(tile_draw_func_t draw_func) {
+    tile_draw_func = draw_func;
+    thread_pool_run(render_tile, NULL, num_tiles_x * num_tiles_y);
+}
+
+void free_tiles(void) {
+    free(tile_offsets);
+    free(tile_triangle_indices);
+    tile_offsets = NULL;
+    tile_triangle_indices = NULL;
+    tile_triangle_indices_capacity = 0;
+}
@@ -0,0 +1,21 @@
+#ifndef TILE_H
+#define TILE_H
+
+#include "display.h"
+#include "triangle.h"
+
+#define TILE_SIZE 64
+
+// Draws one triangle, touching only the pixels inside the tile rect
+typedef void (*tile_draw_func_t)(triangle_t* triangle, rect_t tile_rect);
+
+////////////////////////////////////////////////////////////////////
+// Screen tiles that are rasterized in parallel, every tile owns  //
+// its pixels so the workers never write to the same buffer entry //
+////////////////////////////////////////////////////////////////////
+bool init_tiles(int screen_width, int screen_height);                       // false when the bins cannot be allocated
+bool bin_triangles_into_tiles(triangle_t* triangles, int num_triangles);    // false when the bins are missing or cannot grow
+void render_tiles(tile_draw_func_t draw_func);
+void free_tiles(void);
+
+#endif
@@ -1,110 +1,182 @@
+#include <math.h>
 #include "triangle.h"
+#include "sampler.h"
+
+/////////////////////////////////////////////////////
+// Edge functions for the half-space rasterizer    //
+/////////////////////////////////////////////////////
+// Twice the signed area of the triangle (a, b, p), positive when p is on the inner side of the edge a->b
+static int edge_function(int ax, int ay, int bx, int by, int px, int py) {
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
 
-void draw_triangle_pixel(
-    int x, int y, uint32_t color,
-    vec4_t point_a, vec4_t point_b, vec4_t point_c
-) {
-    vec2_t p = { x, y };
-    vec2_t a = vec2_from_vec4(point_a);
-    vec2_t b = vec2_from_vec4(point_b);
-    vec2_t c = vec2_from_vec4(point_c);
-
-    vec3_t weights = barycentric_weights(a, b, c, p);
-
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    float interpolated_reciprocal_w;
-    
-    interpolated_reciprocal_w = (1 / point_a.w) * alpha + (1 / point_b.w) * beta + (1 / point_c.w) * gamma;
+// Top edges are horizontal with the rest of the triangle below them, left edges go up the left side
+static bool is_top_left(int ax, int ay, int bx, int by) {
+    return (ay == by && bx > ax) || (by < ay);
+}
 
-    // Adjust reciprocal of w so the pixel that are closer to the camera have smaller values than the pixels that are far away
-    interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
+static int min3(int a, int b, int c) {
+    int m = a < b ? a : b;
+    return m < c ? m : c;
+}
 
-    // Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
-    if (interpolated_reciprocal_w < z_buffer[(window_width * y) + x]) {
-        draw_pixel(x, y, color);
+static int max3(int a, int b, int c) {
+    int m = a > b ? a : b;
+    return m > c ? m : c;
+}
 
-        // Update z-buffer value with 1/w of the current pixel
-        z_buffer[(window_width * y) + x] = interpolated_reciprocal_w;
-    }
+static float texel_footprint_squared(float du, float dv) {
+    return du * du + dv * dv;
 }
 
-void draw_filled_triangle(
-    int x0, int y0, float z0, float w0,
-    int x1, int y1, float z1, float w1,
-    int x2, int y2, float z2, float w2,
-    uint32_t color
+//////////////////////////////////////////////////////////////////////////////
+// Rasterize a triangle by testing every pixel of its bounding box against  //
+// the three edge functions. The edge functions are set up once and stepped //
+// with integer additions, so there is no per-pixel barycentric setup.      //
+// A NULL texture fills the triangle with the flat color instead, textured  //
+// pixels are sampled from the mip levels that match their footprint.       //
+// Every pixel is computed from its own integer edge values, so the result  //
+// does not depend on the rect the triangle is drawn through.               //
+//////////////////////////////////////////////////////////////////////////////
+static void rasterize_triangle(
+    int x0, int y0, float w0, float u0, float v0,
+    int x1, int y1, float w1, float u1, float v1,
+    int x2, int y2, float w2, float u2, float v2,
+    uint32_t color, const texture_t* texture, rect_t rect
 ) {
-    // Sort the vertices by y-coordinate (y0 < y1 < y2)
-    if (y0 > y1) {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
-    }
-    if (y1 > y2) {
-        int_swap(&y1, &y2);
+    // Make the triangle wind so its edge functions are positive inside, and skip degenerate triangles
+    int area = edge_function(x0, y0, x1, y1, x2, y2);
+    if (area == 0) return;
+    if (area < 0) {
         int_swap(&x1, &x2);
-        float_swap(&z1, &z2);
+        int_swap(&y1, &y2);
         float_swap(&w1, &w2);
-    }
-    if (y0 > y1) {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
+        float_swap(&u1, &u2);
+        float_swap(&v1, &v2);
+        area = -area;
     }
 
-    // Create vector points after we sort the vertices
-    vec4_t point_a = { x0, y0, z0, w0 };
-    vec4_t point_b = { x1, y1, z1, w1 };
-    vec4_t point_c = { x2, y2, z2, w2 };
-
-    /////////////////////////////////////////////////////////
-    // Render the upper part of the triangle (flat-bottom) //
-    /////////////////////////////////////////////////////////
-    float inv_slope_1 = 0;
-    float inv_slope_2 = 0;
-
-    if (y1 - y0 != 0) inv_slope_1 = (float)(x1 - x0) / abs(y1 - y0);
-    if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-    
-    if (y1 - y0 != 0) {
-        for (int y = y0; y <= y1; y++) {
-            int x_start = x1 + (y - y1) * inv_slope_1;
-            int x_end = x0 + (y - y0) * inv_slope_2;
-
-            if (x_end < x_start) int_swap(&x_start, &x_end);    // swap if x_strat is to the right of x_end
-
-            for (int x = x_start; x < x_end; x++) {
-                draw_triangle_pixel(x, y, color, point_a, point_b, point_c);
+    // Bounding box of the triangle clamped to the rect
+    int min_x = min3(x0, x1, x2);
+    int min_y = min3(y0, y1, y2);
+    int max_x = max3(x0, x1, x2);
+    int max_y = max3(y0, y1, y2);
+    if (min_x < rect.min_x) min_x = rect.min_x;
+    if (min_y < rect.min_y) min_y = rect.min_y;
+    if (max_x > rect.max_x) max_x = rect.max_x;
+    if (max_y > rect.max_y) max_y = rect.max_y;
+    if (min_x > max_x || min_y > max_y) return;
+
+    // Pixels exactly on an edge only belong to the triangle if it is a top or left edge,
+    // so edges shared by two triangles are drawn exactly once
+    int bias0 = is_top_left(x1, y1, x2, y2) ? 0 : -1;
+    int bias1 = is_top_left(x2, y2, x0, y0) ? 0 : -1;
+    int bias2 = is_top_left(x0, y0, x1, y1) ? 0 : -1;
+
+    // Increments of each edge function when moving one pixel in x and in y
+    int step_x0 = y1 - y2, step_y0 = x2 - x1;
+    int step_x1 = y2 - y0, step_y1 = x0 - x2;
+    int step_x2 = y0 - y1, step_y2 = x1 - x0;
+
+    // Edge functions at the top-left corner of the bounding box, biased by the fill rule
+    int row0 = edge_function(x1, y1, x2, y2, min_x, min_y) + bias0;
+    int row1 = edge_function(x2, y2, x0, y0, min_x, min_y) + bias1;
+    int row2 = edge_function(x0, y0, x1, y1, min_x, min_y) + bias2;
+
+    // Attributes divided by w so they can be interpolated linearly in screen space
+    float inv_area = 1.0 / area;
+    float reciprocal_w0 = 1 / w0, reciprocal_w1 = 1 / w1, reciprocal_w2 = 1 / w2;
+    float u0_over_w = u0 * reciprocal_w0, u1_over_w = u1 * reciprocal_w1, u2_over_w = u2 * reciprocal_w2;
+    float v0_over_w = v0 * reciprocal_w0, v1_over_w = v1 * reciprocal_w1, v2_over_w = v2 * reciprocal_w2;
+
+    // Screen-space derivatives of the linearly interpolated values, in texels of level 0, for picking the mip level per pixel
+    float texels_u = texture != NULL ? texture->levels[0].width : 0;
+    float texels_v = texture != NULL ? texture->levels[0].height : 0;
+    float dq_dx = ((reciprocal_w1 - reciprocal_w0) * step_x1 + (reciprocal_w2 - reciprocal_w0) * step_x2) * inv_area;
+    float dq_dy = ((reciprocal_w1 - reciprocal_w0) * step_y1 + (reciprocal_w2 - reciprocal_w0) * step_y2) * inv_area;
+    float du_dx = ((u1_over_w - u0_over_w) * step_x1 + (u2_over_w - u0_over_w) * step_x2) * inv_area * texels_u;
+    float du_dy = ((u1_over_w - u0_over_w) * step_y1 + (u2_over_w - u0_over_w) * step_y2) * inv_area * texels_u;
+    float dv_dx = ((v1_over_w - v0_over_w) * step_x1 + (v2_over_w - v0_over_w) * step_x2) * inv_area * texels_v;
+    float dv_dy = ((v1_over_w - v0_over_w) * step_y1 + (v2_over_w - v0_over_w) * step_y2) * inv_area * texels_v;
+
+    for (int y = min_y; y <= max_y; y++) {
+        int e0 = row0;
+        int e1 = row1;
+        int e2 = row2;
+
+        for (int x = min_x; x <= max_x; x++) {
+            // The pixel is inside when none of the edge functions is negative
+            if ((e0 | e1 | e2) >= 0) {
+                float beta = (e1 - bias1) * inv_area;
+                float gamma = (e2 - bias2) * inv_area;
+
+                float interpolated_reciprocal_w = reciprocal_w0 + (reciprocal_w1 - reciprocal_w0) * beta + (reciprocal_w2 - reciprocal_w0) * gamma;
+
+                // Adjust reciprocal of w so the pixel that are closer to the camera have smaller values than the pixels that are far away
+                float depth = 1.0 - interpolated_reciprocal_w;
+
+                // Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
+                if (depth < z_buffer[(window_width * y) + x]) {
+                    uint32_t pixel_color = color;
+
+                    if (texture != NULL) {
+                        float interpolated_u = u0_over_w + (u1_over_w - u0_over_w) * beta + (u2_over_w - u0_over_w) * gamma;
+                        float interpolated_v = v0_over_w + (v1_over_w - v0_over_w) * beta + (v2_over_w - v0_over_w) * gamma;
+
+                        interpolated_u /= interpolated_reciprocal_w;
+                        interpolated_v /= interpolated_reciprocal_w;
+
+                        // Derivatives of u and v themselves follow from the quotient rule on (u / w) / (1 / w)
+                        float w = 1 / interpolated_reciprocal_w;
+                        float u_texels = interpolated_u * texels_u;
+                        float v_texels = interpolated_v * texels_v;
+                        float footprint_x = texel_footprint_squared((du_dx - u_texels * dq_dx) * w, (dv_dx - v_texels * dq_dx) * w);
+                        float footprint_y = texel_footprint_squared((du_dy - u_texels * dq_dy) * w, (dv_dy - v_texels * dq_dy) * w);
+                        pixel_color = sample_texture(texture, &texture_sampler, interpolated_u, interpolated_v, fmaxf(footprint_x, footprint_y));
+                    }
+
+                    color_buffer[(window_width * y) + x] = pixel_color;
+
+                    // Update z-buffer value with 1/w of the current pixel
+                    z_buffer[(window_width * y) + x] = depth;
+                }
             }
+            e0 += step_x0;
+            e1 += step_x1;
+            e2 += step_x2;
         }
+        row0 += step_y0;
+        row1 += step_y1;
+        row2 += step_y2;
     }
+}
 
-    //////////////////////////////////////////////////////
-    // Render the lower part of the triangle (flat-top) //
-    //////////////////////////////////////////////////////
-    inv_slope_1 = 0;
-    inv_slope_2 = 0;
-
-    if (y2 - y1 != 0) inv_slope_1 = (float)(x2 - x1) / abs(y2 - y1);
-    if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-    
-    if (y2 - y1 != 0) {
-        for (int y = y1; y <= y2; y++) {
-            int x_start = x1 + (y - y1) * inv_slope_1;
-            int x_end = x0 + (y - y0) * inv_slope_2;
-
-            if (x_end < x_start) int_swap(&x_start, &x_end);    // swap if x_strat is to the right of x_end
+void draw_filled_triangle(
+    int x0, int y0, float w0,
+    int x1, int y1, float w1,
+    int x2, int y2, float w2,
+    uint32_t color
+) {
+    draw_filled_triangle_in_rect(
+        x0, y0, w0,
+        x1, y1, w1,
+        x2, y2, w2,
+        color, screen_rect()
+    );
+}
 
-            for (int x = x_start; x < x_end; x++) {
-                draw_triangle_pixel(x, y, color, point_a, point_b, point_c);
-            }
-        }
-    }
+void draw_filled_triangle_in_rect(
+    int x0, int y0, float w0,
+    int x1, int y1, float w1,
+    int x2, int y2, float w2,
+    uint32_t color, rect_t rect
+) {
+    rasterize_triangle(
+        x0, y0, w0, 0, 0,
+        x1, y1, w1, 0, 0,
+        x2, y2, w2, 0, 0,
+        color, NULL, rect
+    );
 }
 
 vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p) {
@@ -131,132 +203,73 @@ vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p) {
     return weights;
 }
 
-void draw_texel(
-    int x, int y, uint32_t* texture,
-    vec4_t point_a, vec4_t point_b, vec4_t point_c,
-    float u0, float v0, float u1, float v1, float u2, float v2
-) {
-    vec2_t p = { x, y };
-    vec2_t a = vec2_from_vec4(point_a);
-    vec2_t b = vec2_from_vec4(point_b);
-    vec2_t c = vec2_from_vec4(point_c);
-
-    vec3_t weights = barycentric_weights(a, b, c, p);
-
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    float interpolated_u;
-    float interpolated_v;
-    float interpolated_reciprocal_w;
-
-    interpolated_u = (u0 / point_a.w) * alpha + (u1 / point_b.w) * beta + (u2 / point_c.w) * gamma;
-    interpolated_v = (v0 / point_a.w) * alpha + (v1 / point_b.w) * beta + (v2 / point_c.w) * gamma;
-    
-    interpolated_reciprocal_w = (1 / point_a.w) * alpha + (1 / point_b.w) * beta + (1 / point_c.w) * gamma;
-
-    interpolated_u /= interpolated_reciprocal_w;
-    interpolated_v /= interpolated_reciprocal_w;
-
-    int tex_x = abs((int)(interpolated_u * texture_width));
-    int tex_y = abs((int)(interpolated_v * texture_height));
-
-    // Adjust reciprocal of w so the pixel that are closer to the camera have smaller values than the pixels that are far away
-    interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
-
-    // Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
-    if (interpolated_reciprocal_w < z_buffer[(window_width * y) + x]) {
-        draw_pixel(x, y, texture[(texture_width * tex_y) + tex_x]);
+//////////////////////////////////////////////////////////////////////////////
+// Twice the signed area of a projected triangle with its vertices snapped  //
+// to the pixel grid the same way the rasterizer snaps them. This is the    //
+// area_parallelogram_abc of barycentric_weights with the opposite sign, so //
+// it is positive for front faces and negative for back faces. A triangle   //
+// that snaps to zero area cannot cover any pixel.                          //
+//////////////////////////////////////////////////////////////////////////////
+int snapped_triangle_area(vec4_t a, vec4_t b, vec4_t c) {
+    return edge_function((int)a.x, (int)a.y, (int)b.x, (int)b.y, (int)c.x, (int)c.y);
+}
 
-        // Update z-buffer value with 1/w of the current pixel
-        z_buffer[(window_width * y) + x] = interpolated_reciprocal_w;
+// True when a triangle with a positive snapped area lights no pixel. Only triangles whose bounding box
+// spans at most SMALL_TRIANGLE_SIZE pixels are tested, at each pixel of the box with the rasterizer's
+// edge functions and fill rule, so this is exact for them. Larger triangles are assumed to cover a pixel.
+bool is_snapped_triangle_empty(vec4_t a, vec4_t b, vec4_t c) {
+    int x0 = (int)a.x, y0 = (int)a.y;
+    int x1 = (int)b.x, y1 = (int)b.y;
+    int x2 = (int)c.x, y2 = (int)c.y;
+    int min_x = min3(x0, x1, x2);
+    int min_y = min3(y0, y1, y2);
+    int max_x = max3(x0, x1, x2);
+    int max_y = max3(y0, y1, y2);
+    if (max_x - min_x > SMALL_TRIANGLE_SIZE || max_y - min_y > SMALL_TRIANGLE_SIZE) return false;
+
+    int bias0 = is_top_left(x1, y1, x2, y2) ? 0 : -1;
+    int bias1 = is_top_left(x2, y2, x0, y0) ? 0 : -1;
+    int bias2 = is_top_left(x0, y0, x1, y1) ? 0 : -1;
+    for (int y = min_y; y <= max_y; y++) {
+        for (int x = min_x; x <= max_x; x++) {
+            int e0 = edge_function(x1, y1, x2, y2, x, y) + bias0;
+            int e1 = edge_function(x2, y2, x0, y0, x, y) + bias1;
+            int e2 = edge_function(x0, y0, x1, y1, x, y) + bias2;
+            if ((e0 | e1 | e2) >= 0) return false;
+        }
     }
+    return true;
 }
 
 void draw_textured_triangle(
-    int x0, int y0, float z0, float w0, float u0, float v0,
-    int x1, int y1, float z1, float w1, float u1, float v1,
-    int x2, int y2, float z2, float w2, float u2, float v2,
-    uint32_t* texture
+    int x0, int y0, float w0, float u0, float v0,
+    int x1, int y1, float w1, float u1, float v1,
+    int x2, int y2, float w2, float u2, float v2,
+    const texture_t* texture
 ) {
-    // Sort the vertices by y-coordinate (y0 < y1 < y2)
-    if (y0 > y1) {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
-        float_swap(&u0, &u1);
-        float_swap(&v0, &v1);
-    }
-    if (y1 > y2) {
-        int_swap(&y1, &y2);
-        int_swap(&x1, &x2);
-        float_swap(&z1, &z2);
-        float_swap(&w1, &w2);
-        float_swap(&u1, &u2);
-        float_swap(&v1, &v2);
-    }
-    if (y0 > y1) {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
-        float_swap(&u0, &u1);
-        float_swap(&v0, &v1);
-    }
+    draw_textured_triangle_in_rect(
+        x0, y0, w0, u0, v0,
+        x1, y1, w1, u1, v1,
+        x2, y2, w2, u2, v2,
+        texture, screen_rect()
+    );
+}
 
+void draw_textured_triangle_in_rect(
+    int x0, int y0, float w0, float u0, float v0,
+    int x1, int y1, float w1, float u1, float v1,
+    int x2, int y2, float w2, float u2, float v2,
+    const texture_t* texture, rect_t rect
+) {
     // Flip the v component to account for inverted u, v coordinates
     v0 = 1 - v0;
     v1 = 1 - v1;
     v2 = 1 - v2;
 
-    // Create vector points after we sort the vertices
-    vec4_t point_a = { x0, y0, z0, w0 };
-    vec4_t point_b = { x1, y1, z1, w1 };
-    vec4_t point_c = { x2, y2, z2, w2 };
-
-    /////////////////////////////////////////////////////////
-    // Render the upper part of the triangle (flat-bottom) //
-    /////////////////////////////////////////////////////////
-    float inv_slope_1 = 0;
-    float inv_slope_2 = 0;
-
-    if (y1 - y0 != 0) inv_slope_1 = (float)(x1 - x0) / abs(y1 - y0);
-    if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-    
-    if (y1 - y0 != 0) {
-        for (int y = y0; y <= y1; y++) {
-            int x_start = x1 + (y - y1) * inv_slope_1;
-            int x_end = x0 + (y - y0) * inv_slope_2;
-
-            if (x_end < x_start) int_swap(&x_start, &x_end);    // swap if x_strat is to the right of x_end
-
-            for (int x = x_start; x < x_end; x++) {
-                draw_texel(x, y, texture, point_a, point_b, point_c, u0, v0, u1, v1, u2, v2);
-            }
-        }
-    }
-
-    //////////////////////////////////////////////////////
-    // Render the lower part of the triangle (flat-top) //
-    //////////////////////////////////////////////////////
-    inv_slope_1 = 0;
-    inv_slope_2 = 0;
-
-    if (y2 - y1 != 0) inv_slope_1 = (float)(x2 - x1) / abs(y2 - y1);
-    if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-    
-    if (y2 - y1 != 0) {
-        for (int y = y1; y <= y2; y++) {
-            int x_start = x1 + (y - y1) * inv_slope_1;
-            int x_end = x0 + (y - y0) * inv_slope_2;
-
-            if (x_end < x_start) int_swap(&x_start, &x_end);    // swap if x_strat is to the right of x_end
-
-            for (int x = x_start; x < x_end; x++) {
-                draw_texel(x, y, texture, point_a, point_b, point_c, u0, v0, u1, v1, u2, v2);
-            }
-        }
-    }
-}
\ No newline at end of file
+    rasterize_triangle(
+        x0, y0, w0, u0, v0,
+        x1, y1, w1, u1, v1,
+        x2, y2, w2, u2, v2,
+        0, texture, rect
+    );
+}
@@ -9,20 +9,20 @@
 #include "swap.h"
 #include "light.h"
 
+#define SMALL_TRIANGLE_SIZE 3  // triangles up to this many pixels across get an exact coverage test before binning
+
+// Indices of the three vertices of a face, texture coordinates are stored per vertex
 typedef struct {
     int a;
     int b;
     int c;
-    tex2_t a_uv;
-    tex2_t b_uv;
-    tex2_t c_uv;
-    uint32_t color;
 } face_t;
 
 typedef struct {
     vec4_t points[3];
     tex2_t texcoords[3];
     uint32_t color;
+    const texture_t* texture;   // texture of the object the triangle came from, NULL if it has none
 } triangle_t;
 
 void int_swap(int* a, int* b);              // helper function for swaping two variable's values
@@ -31,27 +31,37 @@ void sort_faces(triangle_t* faces);         // helper function to sort an array
 ////////////////////////////////////////////
 // Functions for drawing filled triangles //
 ////////////////////////////////////////////
-void draw_triangle_pixel(
-    int x, int y, uint32_t color,
-    vec4_t point_a, vec4_t point_b, vec4_t point_c
-);
 void draw_filled_triangle(
-    int x0, int y0, float z0, float w0,
-    int x1, int y1, float z1, float w1,
-    int x2, int y2, float z2, float w2,
+    int x0, int y0, float w0,
+    int x1, int y1, float w1,
+    int x2, int y2, float w2,
     uint32_t color
 );
 vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p);
-void draw_texel(
-    int x, int y, uint32_t* texture,
-    vec4_t point_a, vec4_t point_b, vec4_t point_c,
-    float u0, float v0, float u1, float v1, float u2, float v2
-);
+int snapped_triangle_area(vec4_t a, vec4_t b, vec4_t c);
+bool is_snapped_triangle_empty(vec4_t a, vec4_t b, vec4_t c);    // for a positive snapped area only
 void draw_textured_triangle(
-    int x0, int y0, float z0, float w0, float u0, float v0,
-    int x1, int y1, float z1, float w1, float u1, float v1,
-    int x2, int y2, float z2, float w2, float u2, float v2,
-    uint32_t* texture
+    int x0, int y0, float w0, float u0, float v0,
+    int x1, int y1, float w1, float u1, float v1,
+    int x2, int y2, float w2, float u2, float v2,
+    const texture_t* texture
+);
+
+////////////////////////////////////////////////////////////
+// Versions that only draw the pixels inside a rect, used //
+// by the tiled renderer to give each tile its own pixels //
+////////////////////////////////////////////////////////////
+void draw_filled_triangle_in_rect(
+    int x0, int y0, float w0,
+    int x1, int y1, float w1,
+    int x2, int y2, float w2,
+    uint32_t color, rect_t rect
+);
+void draw_textured_triangle_in_rect(
+    int x0, int y0, float w0, float u0, float v0,
+    int x1, int y1, float w1, float u1, float v1,
+    int x2, int y2, float w2, float u2, float v2,
+    const texture_t* texture, rect_t rect
 );
 
 #endif
\ No newline at end of file
@@ -28,8 +28,10 @@ freely, subject to the following restrictions:
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
 
 #include "upng.h"
+#include "simd.h"
 
 #define MAKE_BYTE(b) ((b) & 0xFF)
 #define MAKE_DWORD(a,b,c,d) ((MAKE_BYTE(a) << 24) | (MAKE_BYTE(b) << 16) | (MAKE_BYTE(c) << 8) | MAKE_BYTE(d))
@@ -47,14 +49,8 @@ freely, subject to the following restrictions:
 #define NUM_CODE_LENGTH_CODES 19	/*the code length codes. 0-15: code lengths, 16: copy previous 3-6 times, 17: 3-10 zeros, 18: 11-138 zeros */
 #define MAX_SYMBOLS 288 /* largest number of symbols used by any tree type */
 
-#define DEFLATE_CODE_BITLEN 15
-#define DISTANCE_BITLEN 15
-#define CODE_LENGTH_BITLEN 7
 #define MAX_BIT_LENGTH 15 /* largest bitlen used by any tree type */
-
-#define DEFLATE_CODE_BUFFER_SIZE (NUM_DEFLATE_CODE_SYMBOLS * 2)
-#define DISTANCE_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
-#define CODE_LENGTH_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
+#define HUFFMAN_TABLE_BITS 9	/* codes up to this long are decoded with a single table lookup */
 
 #define SET_ERROR(upng,code) do { (upng)->error = (code); (upng)->error_line = __LINE__; } while (0)
 
@@ -100,11 +96,21 @@ struct upng_t {
 	upng_source		source;
 };
 
-typedef struct huffman_tree {
-	unsigned* tree2d;
-	unsigned maxbitlen;	/*maximum number of bits a single code can get */
-	unsigned numcodes;	/*number of symbols in the alphabet = number of codes */
-} huffman_tree;
+typedef struct bit_reader {
+	const unsigned char*	in;
+	unsigned long			inlength;
+	unsigned long			bytepos;	/* next byte to move into the bit buffer */
+	uint64_t				bits;		/* buffered bits, the next bit of the stream is the lowest */
+	unsigned				numbits;	/* number of buffered bits */
+} bit_reader;
+
+typedef struct huffman_table {
+	unsigned short fast[1 << HUFFMAN_TABLE_BITS];	/*symbol << 4 | code length for every code of up to HUFFMAN_TABLE_BITS bits, indexed by the next bits of the stream, 0 for longer codes */
+	unsigned maxcode[MAX_BIT_LENGTH + 1];	/*end of the codes of each length, left aligned to 16 bits */
+	unsigned firstcode[MAX_BIT_LENGTH + 1];	/*first code of each length */
+	unsigned firstsymbol[MAX_BIT_LENGTH + 1];	/*index in sorted of the symbol of that code */
+	unsigned short sorted[MAX_SYMBOLS];	/*the symbols in the order of their codes */
+} huffman_table;
 
 static const unsigned LENGTH_BASE[29] = {	/*the base lengths represented by codes 257-285 */
 	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
@@ -129,204 +135,218 @@ static const unsigned DISTANCE_EXTRA[30] = {	/*the extra bits of backwards dista
 static const unsigned CLCL[NUM_CODE_LENGTH_CODES]	/*the order in which "code length alphabet code lengths" are stored, out of this the huffman tree of the dynamic huffman tree lengths is generated */
 = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
 
-static const unsigned FIXED_DEFLATE_CODE_TREE[NUM_DEFLATE_CODE_SYMBOLS * 2] = {
-	289, 370, 290, 307, 546, 291, 561, 292, 293, 300, 294, 297, 295, 296, 0, 1,
-	2, 3, 298, 299, 4, 5, 6, 7, 301, 304, 302, 303, 8, 9, 10, 11, 305, 306, 12,
-	13, 14, 15, 308, 339, 309, 324, 310, 317, 311, 314, 312, 313, 16, 17, 18,
-	19, 315, 316, 20, 21, 22, 23, 318, 321, 319, 320, 24, 25, 26, 27, 322, 323,
-	28, 29, 30, 31, 325, 332, 326, 329, 327, 328, 32, 33, 34, 35, 330, 331, 36,
-	37, 38, 39, 333, 336, 334, 335, 40, 41, 42, 43, 337, 338, 44, 45, 46, 47,
-	340, 355, 341, 348, 342, 345, 343, 344, 48, 49, 50, 51, 346, 347, 52, 53,
-	54, 55, 349, 352, 350, 351, 56, 57, 58, 59, 353, 354, 60, 61, 62, 63, 356,
-	363, 357, 360, 358, 359, 64, 65, 66, 67, 361, 362, 68, 69, 70, 71, 364,
-	367, 365, 366, 72, 73, 74, 75, 368, 369, 76, 77, 78, 79, 371, 434, 372,
-	403, 373, 388, 374, 381, 375, 378, 376, 377, 80, 81, 82, 83, 379, 380, 84,
-	85, 86, 87, 382, 385, 383, 384, 88, 89, 90, 91, 386, 387, 92, 93, 94, 95,
-	389, 396, 390, 393, 391, 392, 96, 97, 98, 99, 394, 395, 100, 101, 102, 103,
-	397, 400, 398, 399, 104, 105, 106, 107, 401, 402, 108, 109, 110, 111, 404,
-	419, 405, 412, 406, 409, 407, 408, 112, 113, 114, 115, 410, 411, 116, 117,
-	118, 119, 413, 416, 414, 415, 120, 121, 122, 123, 417, 418, 124, 125, 126,
-	127, 420, 427, 421, 424, 422, 423, 128, 129, 130, 131, 425, 426, 132, 133,
-	134, 135, 428, 431, 429, 430, 136, 137, 138, 139, 432, 433, 140, 141, 142,
-	143, 435, 483, 436, 452, 568, 437, 438, 445, 439, 442, 440, 441, 144, 145,
-	146, 147, 443, 444, 148, 149, 150, 151, 446, 449, 447, 448, 152, 153, 154,
-	155, 450, 451, 156, 157, 158, 159, 453, 468, 454, 461, 455, 458, 456, 457,
-	160, 161, 162, 163, 459, 460, 164, 165, 166, 167, 462, 465, 463, 464, 168,
-	169, 170, 171, 466, 467, 172, 173, 174, 175, 469, 476, 470, 473, 471, 472,
-	176, 177, 178, 179, 474, 475, 180, 181, 182, 183, 477, 480, 478, 479, 184,
-	185, 186, 187, 481, 482, 188, 189, 190, 191, 484, 515, 485, 500, 486, 493,
-	487, 490, 488, 489, 192, 193, 194, 195, 491, 492, 196, 197, 198, 199, 494,
-	497, 495, 496, 200, 201, 202, 203, 498, 499, 204, 205, 206, 207, 501, 508,
-	502, 505, 503, 504, 208, 209, 210, 211, 506, 507, 212, 213, 214, 215, 509,
-	512, 510, 511, 216, 217, 218, 219, 513, 514, 220, 221, 222, 223, 516, 531,
-	517, 524, 518, 521, 519, 520, 224, 225, 226, 227, 522, 523, 228, 229, 230,
-	231, 525, 528, 526, 527, 232, 233, 234, 235, 529, 530, 236, 237, 238, 239,
-	532, 539, 533, 536, 534, 535, 240, 241, 242, 243, 537, 538, 244, 245, 246,
-	247, 540, 543, 541, 542, 248, 249, 250, 251, 544, 545, 252, 253, 254, 255,
-	547, 554, 548, 551, 549, 550, 256, 257, 258, 259, 552, 553, 260, 261, 262,
-	263, 555, 558, 556, 557, 264, 265, 266, 267, 559, 560, 268, 269, 270, 271,
-	562, 565, 563, 564, 272, 273, 274, 275, 566, 567, 276, 277, 278, 279, 569,
-	572, 570, 571, 280, 281, 282, 283, 573, 574, 284, 285, 286, 287, 0, 0
-};
-
-static const unsigned FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
-	33, 48, 34, 41, 35, 38, 36, 37, 0, 1, 2, 3, 39, 40, 4, 5, 6, 7, 42, 45, 43,
-	44, 8, 9, 10, 11, 46, 47, 12, 13, 14, 15, 49, 56, 50, 53, 51, 52, 16, 17,
-	18, 19, 54, 55, 20, 21, 22, 23, 57, 60, 58, 59, 24, 25, 26, 27, 61, 62, 28,
-	29, 30, 31, 0, 0
-};
+/* the next 64 bits of the stream in one load, the first byte in the lowest bits */
+static uint64_t load_le64(const unsigned char *p)
+{
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+		((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
 
-static unsigned char read_bit(unsigned long *bitpointer, const unsigned char *bitstream)
+static void bit_reader_init(bit_reader* br, const unsigned char *in, unsigned long inlength)
 {
-	unsigned char result = (unsigned char)((bitstream[(*bitpointer) >> 3] >> ((*bitpointer) & 0x7)) & 1);
-	(*bitpointer)++;
-	return result;
+	br->in = in;
+	br->inlength = inlength;
+	br->bytepos = 0;
+	br->bits = 0;
+	br->numbits = 0;
 }
 
-static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long nbits)
+/* refill near the end of the input a byte at a time, past the end the buffer is filled with zero bits */
+static void bit_reader_refill_tail(bit_reader* br)
 {
-	unsigned result = 0, i;
-	for (i = 0; i < nbits; i++)
-		result |= ((unsigned)read_bit(bitpointer, bitstream)) << i;
-	return result;
+	while (br->numbits <= 56) {
+		uint64_t byte = br->bytepos < br->inlength ? br->in[br->bytepos] : 0;
+		br->bits |= byte << br->numbits;
+		br->bytepos++;
+		br->numbits += 8;
+	}
 }
 
-/* the buffer must be numcodes*2 in size! */
-static void huffman_tree_init(huffman_tree* tree, unsigned* buffer, unsigned numcodes, unsigned maxbitlen)
+/* top the buffer up to at least 57 bits */
+static void bit_reader_refill(bit_reader* br)
 {
-	tree->tree2d = buffer;
+	if (br->bytepos + 8 > br->inlength) {
+		bit_reader_refill_tail(br);
+		return;
+	}
 
-	tree->numcodes = numcodes;
-	tree->maxbitlen = maxbitlen;
+	/* take the whole bytes that fit, the bits of the next byte that also land in the buffer are the same ones it will get next time */
+	br->bits |= load_le64(br->in + br->bytepos) << br->numbits;
+	br->bytepos += (63 - br->numbits) >> 3;
+	br->numbits |= 56;
 }
 
-/*given the code lengths (as stored in the PNG file), generate the tree as defined by Deflate. maxbitlen is the maximum bits that a code in the tree can have. return value is error.*/
-static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const unsigned *bitlen)
+/* number of bits consumed so far */
+static unsigned long bit_reader_position(const bit_reader* br)
 {
-	unsigned tree1d[MAX_SYMBOLS];
-	unsigned blcount[MAX_BIT_LENGTH];
-	unsigned nextcode[MAX_BIT_LENGTH+1];
-	unsigned bits, n, i;
-	unsigned nodefilled = 0;	/*up to which node it is filled */
-	unsigned treepos = 0;	/*position in the tree (1 of the numcodes columns) */
-
-	/* initialize local vectors */
-	memset(blcount, 0, sizeof(blcount));
-	memset(nextcode, 0, sizeof(nextcode));
+	return br->bytepos * 8 - br->numbits;
+}
 
-	/*step 1: count number of instances of each code length */
-	for (bits = 0; bits < tree->numcodes; bits++) {
-		blcount[bitlen[bits]]++;
-	}
+/* true once more bits were consumed than the input has, those bits were zero padding */
+static int bit_reader_past_end(const bit_reader* br)
+{
+	return bit_reader_position(br) > br->inlength * 8;
+}
 
-	/*step 2: generate the nextcode values */
-	for (bits = 1; bits <= tree->maxbitlen; bits++) {
-		nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
+/* read up to 32 bits, the first bit read ends up in the lowest bit of the result */
+static unsigned read_bits(bit_reader* br, unsigned nbits)
+{
+	unsigned result;
+	if (br->numbits < nbits) {
+		bit_reader_refill(br);
 	}
+	result = (unsigned)(br->bits & (((uint64_t)1 << nbits) - 1));
+	br->bits >>= nbits;
+	br->numbits -= nbits;
+	return result;
+}
 
-	/*step 3: generate all the codes */
-	for (n = 0; n < tree->numcodes; n++) {
-		if (bitlen[n] != 0) {
-			tree1d[n] = nextcode[bitlen[n]]++;
-		}
+static unsigned reverse_bits(unsigned code, unsigned nbits)
+{
+	unsigned result = 0, i;
+	for (i = 0; i < nbits; i++) {
+		result = (result << 1) | ((code >> i) & 1);
 	}
+	return result;
+}
 
-	/*convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means uninited, a value >= numcodes is an address to another bit, a value < numcodes is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as many columns as codes - 1
-	   a good huffmann tree has N * 2 - 1 nodes, of which N - 1 are internal nodes. Here, the internal nodes are stored (what their 0 and 1 option point to). There is only memory for such good tree currently, if there are more nodes (due to too long length codes), error 55 will happen */
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		tree->tree2d[n] = 32767;	/*32767 here means the tree2d isn't filled there yet */
-	}
+/*given the code lengths (as stored in the PNG file), generate the canonical codes as defined by Deflate and the lookup table for the short ones*/
+static void huffman_table_create_lengths(upng_t* upng, huffman_table* table, const unsigned *bitlen, unsigned numcodes)
+{
+	unsigned blcount[MAX_BIT_LENGTH + 1];
+	unsigned nextcode[MAX_BIT_LENGTH + 1];
+	unsigned code = 0, numsymbols = 0;
+	unsigned bits, n;
 
-	for (n = 0; n < tree->numcodes; n++) {	/*the codes */
-		for (i = 0; i < bitlen[n]; i++) {	/*the bits for this code */
-			unsigned char bit = (unsigned char)((tree1d[n] >> (bitlen[n] - i - 1)) & 1);
-			/* check if oversubscribed */
-			if (treepos > tree->numcodes - 2) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
+	memset(blcount, 0, sizeof(blcount));
+	memset(table->fast, 0, sizeof(table->fast));
 
-			if (tree->tree2d[2 * treepos + bit] == 32767) {	/*not yet filled in */
-				if (i + 1 == bitlen[n]) {	/*last bit */
-					tree->tree2d[2 * treepos + bit] = n;	/*put the current code in it */
-					treepos = 0;
-				} else {	/*put address of the next step in here, first that address has to be found of course (it's just nodefilled + 1)... */
-					nodefilled++;
-					tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;	/*addresses encoded with numcodes added to it */
-					treepos = nodefilled;
-				}
-			} else {
-				treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
-			}
+	/*step 1: count number of instances of each code length */
+	for (n = 0; n < numcodes; n++) {
+		blcount[bitlen[n]]++;
+	}
+	blcount[0] = 0;
+
+	/*step 2: the first code of every length, codes of one length follow each other. The codes of each length end where the codes of the next length begin, left aligned to 16 bits */
+	for (bits = 1; bits <= MAX_BIT_LENGTH; bits++) {
+		nextcode[bits] = code;
+		table->firstcode[bits] = code;
+		table->firstsymbol[bits] = numsymbols;
+		code += blcount[bits];
+		/* check if oversubscribed */
+		if (code > (1u << bits)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
 		}
+		table->maxcode[bits] = code << (16 - bits);
+		numsymbols += blcount[bits];
+		code <<= 1;
 	}
 
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		if (tree->tree2d[n] == 32767) {
-			tree->tree2d[n] = 0;	/*remove possible remaining 32767's */
+	/*step 3: assign the codes in symbol order, and fill every table entry whose first bits are a short code. Deflate sends the first bit of a code first, so the index is the code reversed */
+	for (n = 0; n < numcodes; n++) {
+		unsigned len = bitlen[n];
+		if (len == 0) {
+			continue;
 		}
+		table->sorted[table->firstsymbol[len] + nextcode[len] - table->firstcode[len]] = (unsigned short)n;
+		if (len <= HUFFMAN_TABLE_BITS) {
+			unsigned index;
+			for (index = reverse_bits(nextcode[len], len); index < (1u << HUFFMAN_TABLE_BITS); index += 1u << len) {
+				table->fast[index] = (unsigned short)((n << 4) | len);
+			}
+		}
+		nextcode[len]++;
 	}
 }
 
-static unsigned huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+/* the code lengths of the fixed trees of btype 01 */
+static void huffman_table_create_fixed(upng_t* upng, huffman_table* codetable, huffman_table* codetableD)
 {
-	unsigned treepos = 0, ct;
-	unsigned char bit;
-	for (;;) {
-		/* error: end of input memory reached without endcode */
-		if (((*bp) & 0x07) == 0 && ((*bp) >> 3) > inlength) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
-		}
+	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
+	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
+	unsigned n;
 
-		bit = read_bit(bp, in);
+	for (n = 0; n < NUM_DEFLATE_CODE_SYMBOLS; n++) {
+		bitlen[n] = n < 144 ? 8 : (n < 256 ? 9 : (n < 280 ? 7 : 8));
+	}
+	for (n = 0; n < NUM_DISTANCE_SYMBOLS; n++) {
+		bitlenD[n] = 5;
+	}
+	huffman_table_create_lengths(upng, codetable, bitlen, NUM_DEFLATE_CODE_SYMBOLS);
+	huffman_table_create_lengths(upng, codetableD, bitlenD, NUM_DISTANCE_SYMBOLS);
+}
 
-		ct = codetree->tree2d[(treepos << 1) | bit];
-		if (ct < codetree->numcodes) {
-			return ct;
+/* codes longer than HUFFMAN_TABLE_BITS, find the length whose codes include the next 16 bits read as a number */
+static unsigned huffman_decode_long_code(upng_t *upng, bit_reader* br, const huffman_table* table, unsigned *len)
+{
+	unsigned code = reverse_bits((unsigned)(br->bits & 0xFFFF), 16);
+	for (*len = HUFFMAN_TABLE_BITS + 1; *len <= MAX_BIT_LENGTH; (*len)++) {
+		if (code < table->maxcode[*len]) {
+			return table->sorted[table->firstsymbol[*len] + (code >> (16 - *len)) - table->firstcode[*len]];
 		}
+	}
 
-		treepos = ct - codetree->numcodes;
-		if (treepos >= codetree->numcodes) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
-		}
+	/* the bits are not a code of this tree */
+	SET_ERROR(upng, UPNG_EMALFORMED);
+	*len = 0;
+	return 0;
+}
+
+static unsigned huffman_decode_symbol(upng_t *upng, bit_reader* br, const huffman_table* table)
+{
+	unsigned entry, len, symbol;
+
+	if (br->numbits < MAX_BIT_LENGTH) {
+		bit_reader_refill(br);
+	}
+
+	/* short codes take a single lookup that gives both the symbol and its length */
+	entry = table->fast[br->bits & ((1u << HUFFMAN_TABLE_BITS) - 1)];
+	if (entry != 0) {
+		len = entry & 15;
+		symbol = entry >> 4;
+	} else {
+		symbol = huffman_decode_long_code(upng, br, table, &len);
 	}
+
+	br->bits >>= len;
+	br->numbits -= len;
+	return symbol;
 }
 
 /* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, const unsigned char *in, unsigned long *bp, unsigned long inlength)
+static void get_tree_inflate_dynamic(upng_t* upng, huffman_table* codetable, huffman_table* codetableD, bit_reader* br)
 {
+	huffman_table codelengthcodetable;
 	unsigned codelengthcode[NUM_CODE_LENGTH_CODES];
 	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
 	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
 	unsigned n, hlit, hdist, hclen, i;
 
-	/*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated */
-	/*C-code note: use no "return" between ctor and dtor of an uivector! */
-	if ((*bp) >> 3 >= inlength - 2) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
-		return;
-	}
-
 	/* clear bitlen arrays */
 	memset(bitlen, 0, sizeof(bitlen));
 	memset(bitlenD, 0, sizeof(bitlenD));
 
-	/*the bit pointer is or will go past the memory */
-	hlit = read_bits(bp, in, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
-	hdist = read_bits(bp, in, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
-	hclen = read_bits(bp, in, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+	hlit = read_bits(br, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+	hdist = read_bits(br, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+	hclen = read_bits(br, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
 
 	for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
 		if (i < hclen) {
-			codelengthcode[CLCL[i]] = read_bits(bp, in, 3);
+			codelengthcode[CLCL[i]] = read_bits(br, 3);
 		} else {
 			codelengthcode[CLCL[i]] = 0;	/*if not, it must stay 0 */
 		}
 	}
 
-	huffman_tree_create_lengths(upng, codelengthcodetree, codelengthcode);
+	/*the bit pointer is or went past the memory */
+	if (bit_reader_past_end(br)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	huffman_table_create_lengths(upng, &codelengthcodetable, codelengthcode, NUM_CODE_LENGTH_CODES);
 
 	/* bail now if we encountered an error earlier */
 	if (upng->error != UPNG_EOK) {
@@ -336,7 +356,8 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 	/*now we can use this tree to read the lengths for the tree that this function will return */
 	i = 0;
 	while (i < hlit + hdist) {	/*i is the current symbol we're reading in the part that contains the code lengths of lit/len codes and dist codes */
-		unsigned code = huffman_decode_symbol(upng, in, bp, codelengthcodetree, inlength);
+		unsigned code = huffman_decode_symbol(upng, br, &codelengthcodetable);
+		unsigned replength, value;
 		if (upng->error != UPNG_EOK) {
 			break;
 		}
@@ -348,141 +369,94 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 				bitlenD[i - hlit] = code;
 			}
 			i++;
-		} else if (code == 16) {	/*repeat previous */
-			unsigned replength = 3;	/*read in the 2 bits that indicate repeat length (3-6) */
-			unsigned value;	/*set value to the previous code */
+			continue;
+		}
 
-			if ((*bp) >> 3 >= inlength) {
+		if (code == 16) {	/*repeat previous 3-6 times */
+			/* there is no previous length to repeat */
+			if (i == 0) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				break;
 			}
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 2);
-
-			if ((i - 1) < hlit) {
-				value = bitlen[i - 1];
-			} else {
-				value = bitlenD[i - hlit - 1];
-			}
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-
-				if (i < hlit) {
-					bitlen[i] = value;
-				} else {
-					bitlenD[i - hlit] = value;
-				}
-				i++;
-			}
+			replength = 3 + read_bits(br, 2);
+			value = (i - 1) < hlit ? bitlen[i - 1] : bitlenD[i - hlit - 1];
 		} else if (code == 17) {	/*repeat "0" 3-10 times */
-			unsigned replength = 3;	/*read in the bits that indicate repeat length */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
-
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 3);
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* error: i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-
-				if (i < hlit) {
-					bitlen[i] = 0;
-				} else {
-					bitlenD[i - hlit] = 0;
-				}
-				i++;
-			}
+			replength = 3 + read_bits(br, 3);
+			value = 0;
 		} else if (code == 18) {	/*repeat "0" 11-138 times */
-			unsigned replength = 11;	/*read in the bits that indicate repeat length */
-			/* error, bit pointer jumps past memory */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
-
-			replength += read_bits(bp, in, 7);
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-				if (i < hlit)
-					bitlen[i] = 0;
-				else
-					bitlenD[i - hlit] = 0;
-				i++;
-			}
+			replength = 11 + read_bits(br, 7);
+			value = 0;
 		} else {
 			/* somehow an unexisting code appeared. This can never happen. */
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			break;
 		}
+
+		/*error, bit pointer jumps past memory */
+		if (bit_reader_past_end(br)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			break;
+		}
+
+		/*repeat this value in the next lengths */
+		for (n = 0; n < replength; n++) {
+			/* i is larger than the amount of codes */
+			if (i >= hlit + hdist) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				break;
+			}
+			if (i < hlit) {
+				bitlen[i] = value;
+			} else {
+				bitlenD[i - hlit] = value;
+			}
+			i++;
+		}
 	}
 
-	if (upng->error == UPNG_EOK && bitlen[256] == 0) {
+	/*the lengths were read past the end of the input */
+	if (upng->error == UPNG_EOK && bit_reader_past_end(br)) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 	}
 
 	/*the length of the end code 256 must be larger than 0 */
+	if (upng->error == UPNG_EOK && bitlen[256] == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+	}
+
 	/*now we've finally got hlit and hdist, so generate the code trees, and the function is done */
 	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetree, bitlen);
+		huffman_table_create_lengths(upng, codetable, bitlen, NUM_DEFLATE_CODE_SYMBOLS);
 	}
 	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetreeD, bitlenD);
+		huffman_table_create_lengths(upng, codetableD, bitlenD, NUM_DISTANCE_SYMBOLS);
 	}
 }
 
 /*inflate a block with dynamic of fixed Huffman tree*/
-static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength, unsigned btype)
+static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br, unsigned long *pos, unsigned btype)
 {
-	unsigned codetree_buffer[DEFLATE_CODE_BUFFER_SIZE];
-	unsigned codetreeD_buffer[DISTANCE_BUFFER_SIZE];
-	unsigned done = 0;
-
-	huffman_tree codetree;
-	huffman_tree codetreeD;
+	huffman_table codetable;
+	huffman_table codetableD;
 
 	if (btype == 1) {
-		/* fixed trees */
-		huffman_tree_init(&codetree, (unsigned*)FIXED_DEFLATE_CODE_TREE, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, (unsigned*)FIXED_DISTANCE_TREE, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-	} else if (btype == 2) {
-		/* dynamic trees */
-		unsigned codelengthcodetree_buffer[CODE_LENGTH_BUFFER_SIZE];
-		huffman_tree codelengthcodetree;
-
-		huffman_tree_init(&codetree, codetree_buffer, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-		huffman_tree_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
-		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree, in, bp, inlength);
+		huffman_table_create_fixed(upng, &codetable, &codetableD);
+	} else {
+		get_tree_inflate_dynamic(upng, &codetable, &codetableD, br);
 	}
 
-	while (done == 0) {
-		unsigned code = huffman_decode_symbol(upng, in, bp, &codetree, inlength);
+	while (upng->error == UPNG_EOK) {
+		unsigned code = huffman_decode_symbol(upng, br, &codetable);
 		if (upng->error != UPNG_EOK) {
 			return;
 		}
 
 		if (code == 256) {
-			/* end code */
-			done = 1;
+			/* end code, past the end of the input the stream was decoding zero padding */
+			if (bit_reader_past_end(br)) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+			}
+			return;
 		} else if (code <= 255) {
 			/* literal symbol */
 			if ((*pos) >= outsize) {
@@ -493,23 +467,14 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 			/* store output */
 			out[(*pos)++] = (unsigned char)(code);
 		} else if (code >= FIRST_LENGTH_CODE_INDEX && code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
-			/* part 1: get length base */
-			unsigned long length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
-			unsigned codeD, distance, numextrabitsD;
-			unsigned long start, forward, backward, numextrabits;
+			unsigned long length, distance, n;
+			unsigned codeD;
 
-			/* part 2: get extra bits and add the value of that to length */
-			numextrabits = LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX];
-
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
-			length += read_bits(bp, in, numextrabits);
+			/* part 1 and 2: get length base and the value of its extra bits */
+			length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX] + read_bits(br, LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX]);
 
 			/*part 3: get distance code */
-			codeD = huffman_decode_symbol(upng, in, bp, &codetreeD, inlength);
+			codeD = huffman_decode_symbol(upng, br, &codetableD);
 			if (upng->error != UPNG_EOK) {
 				return;
 			}
@@ -520,60 +485,51 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 				return;
 			}
 
-			distance = DISTANCE_BASE[codeD];
-
 			/*part 4: get extra bits from distance */
-			numextrabitsD = DISTANCE_EXTRA[codeD];
+			distance = DISTANCE_BASE[codeD] + read_bits(br, DISTANCE_EXTRA[codeD]);
 
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
+			/* error, bit pointer jumped past memory */
+			if (bit_reader_past_end(br)) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
 
-			distance += read_bits(bp, in, numextrabitsD);
-
-			/*part 5: fill in all the out[n] values based on the length and dist */
-			start = (*pos);
-			backward = start - distance;
-
-			if ((*pos) + length >= outsize) {
+			/* the match has to start inside the output so far and end inside the buffer */
+			if (distance > (*pos) || (*pos) + length > outsize) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
 
-			for (forward = 0; forward < length; forward++) {
-				out[(*pos)++] = out[backward];
-				backward++;
-
-				if (backward >= start) {
-					backward = start - distance;
-				}
+			/*part 5: fill in all the out[n] values based on the length and dist, a match that overlaps itself repeats the bytes it just wrote */
+			for (n = 0; n < length; n++) {
+				out[*pos] = out[(*pos) - distance];
+				(*pos)++;
 			}
+		} else {
+			/* codes 286 and 287 are never used */
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
 		}
 	}
 }
 
-static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength)
+static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br, unsigned long *pos)
 {
 	unsigned long p;
-	unsigned len, nlen, n;
+	unsigned len, nlen;
 
 	/* go to first boundary of byte */
-	while (((*bp) & 0x7) != 0) {
-		(*bp)++;
-	}
-	p = (*bp) / 8;		/*byte position */
+	p = (bit_reader_position(br) + 7) / 8;		/*byte position */
 
 	/* read len (2 bytes) and nlen (2 bytes) */
-	if (p >= inlength - 4) {
+	if (p + 4 > br->inlength) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	len = in[p] + 256 * in[p + 1];
+	len = br->in[p] + 256 * br->in[p + 1];
 	p += 2;
-	nlen = in[p] + 256 * in[p + 1];
+	nlen = br->in[p] + 256 * br->in[p + 1];
 	p += 2;
 
 	/* check if 16-bit nlen is really the one's complement of len */
@@ -582,53 +538,57 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
 		return;
 	}
 
-	if ((*pos) + len >= outsize) {
+	if ((*pos) + len > outsize) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
 	/* read the literal data: len bytes are now stored in the out buffer */
-	if (p + len > inlength) {
+	if (p + len > br->inlength) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	for (n = 0; n < len; n++) {
-		out[(*pos)++] = in[p++];
-	}
+	memcpy(out + (*pos), br->in + p, len);
+	(*pos) += len;
 
-	(*bp) = p * 8;
+	/* continue reading bits after the literal data, with an empty buffer */
+	br->bytepos = p + len;
+	br->bits = 0;
+	br->numbits = 0;
 }
 
 /*inflate the deflated data (cfr. deflate spec); return value is the error*/
 static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long insize, unsigned long inpos)
 {
-	unsigned long bp = 0;	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
+	bit_reader br;	/*reads the "in" data from inpos on, bits from lsb to msb of each byte */
 	unsigned long pos = 0;	/*byte position in the out buffer */
 
 	unsigned done = 0;
 
+	bit_reader_init(&br, &in[inpos], insize - inpos);
+
 	while (done == 0) {
 		unsigned btype;
 
-		/* ensure next bit doesn't point past the end of the buffer */
-		if ((bp >> 3) >= insize) {
+		/* read block control bits */
+		done = read_bits(&br, 1);
+		btype = read_bits(&br, 2);
+
+		/* ensure the control bits did not point past the end of the buffer */
+		if (bit_reader_past_end(&br)) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		}
 
-		/* read block control bits */
-		done = read_bit(&bp, &in[inpos]);
-		btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
-
 		/* process control type appropriateyly */
 		if (btype == 3) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		} else if (btype == 0) {
-			inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
+			inflate_uncompressed(upng, out, outsize, &br, &pos);	/*no compression */
 		} else {
-			inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
+			inflate_huffman(upng, out, outsize, &br, &pos, btype);	/*compression, btype 01 or 10 */
 		}
 
 		/* stop if an error has occured */
@@ -750,6 +710,124 @@ static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned
 	}
 }
 
+#ifdef SIMD_X86
+/*
+   SSE2 version of unfilter_scanline, giving the same bytes. Up works on 16 bytes at a time for any pixel size. For 4 byte pixels
+   (8-bit RGBA and 16-bit gray with alpha) Sub adds up 4 pixels per step with a prefix sum, while Average and Paeth depend on the
+   pixel just written and work on the 4 channels of one pixel per step. Everything else, including the first scanline of the
+   image that has no precon, goes through the scalar code.
+ */
+SIMD_TARGET_SSE2
+static __m128i load_pixel(const unsigned char *p)
+{
+	int pixel;
+	memcpy(&pixel, p, 4);
+	return _mm_cvtsi32_si128(pixel);
+}
+
+SIMD_TARGET_SSE2
+static void store_pixel(unsigned char *p, __m128i pixel)
+{
+	int value = _mm_cvtsi128_si32(pixel);
+	memcpy(p, &value, 4);
+}
+
+SIMD_TARGET_SSE2
+static void unfilter_up_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+	unsigned long i;
+	for (i = 0; i + 16 <= length; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(precon + i));
+		_mm_storeu_si128((__m128i*)(recon + i), _mm_add_epi8(x, b));
+	}
+	for (; i < length; i++)
+		recon[i] = scanline[i] + precon[i];
+}
+
+SIMD_TARGET_SSE2
+static void unfilter_sub4_sse2(unsigned char *recon, const unsigned char *scanline, unsigned long length)
+{
+	__m128i a = _mm_setzero_si128();	/*last reconstructed pixel, in all four 32-bit lanes */
+	unsigned long i;
+	for (i = 0; i + 16 <= length; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi8(x, a);
+		_mm_storeu_si128((__m128i*)(recon + i), x);
+		a = _mm_shuffle_epi32(x, 0xFF);
+	}
+	for (; i < length; i += 4) {
+		a = _mm_add_epi8(load_pixel(scanline + i), a);
+		store_pixel(recon + i, a);
+	}
+}
+
+SIMD_TARGET_SSE2
+static void unfilter_average4_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+	__m128i one = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	unsigned long i;
+	for (i = 0; i < length; i += 4) {
+		/*avg_epu8 rounds up, take the lost low bit back off to round down like (a + b) / 2 */
+		__m128i b = load_pixel(precon + i);
+		__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		a = _mm_add_epi8(load_pixel(scanline + i), average);
+		store_pixel(recon + i, a);
+	}
+}
+
+SIMD_TARGET_SSE2
+static void unfilter_paeth4_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i a = zero;	/*left and upper left pixels as 16-bit lanes */
+	__m128i c = zero;
+	unsigned long i;
+	for (i = 0; i < length; i += 4) {
+		__m128i b = _mm_unpacklo_epi8(load_pixel(precon + i), zero);
+
+		/*with p = a + b - c the distances are |b - c|, |a - c| and |a + b - 2c| */
+		__m128i bc = _mm_sub_epi16(b, c);
+		__m128i ac = _mm_sub_epi16(a, c);
+		__m128i abc = _mm_add_epi16(ac, bc);
+		__m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+		__m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+		__m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+
+		/*a wins ties over b and c, and b wins ties over c, as in paeth_predictor */
+		__m128i smallest = _mm_min_epi16(_mm_min_epi16(pa, pb), pc);
+		__m128i use_a = _mm_cmpeq_epi16(pa, smallest);
+		__m128i use_b = _mm_andnot_si128(use_a, _mm_cmpeq_epi16(pb, smallest));
+		__m128i predictor = _mm_or_si128(_mm_and_si128(use_a, a), _mm_and_si128(use_b, b));
+		predictor = _mm_or_si128(predictor, _mm_andnot_si128(_mm_or_si128(use_a, use_b), c));
+
+		__m128i pixel = _mm_add_epi8(load_pixel(scanline + i), _mm_packus_epi16(predictor, predictor));
+		store_pixel(recon + i, pixel);
+		a = _mm_unpacklo_epi8(pixel, zero);
+		c = b;
+	}
+}
+
+SIMD_TARGET_SSE2
+static void unfilter_scanline_sse2(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
+{
+	if (filterType == 2 && precon) {
+		unfilter_up_sse2(recon, scanline, precon, length);
+	} else if (filterType == 1 && bytewidth == 4) {
+		unfilter_sub4_sse2(recon, scanline, length);
+	} else if (filterType == 3 && bytewidth == 4 && precon) {
+		unfilter_average4_sse2(recon, scanline, precon, length);
+	} else if (filterType == 4 && bytewidth == 4 && precon) {
+		unfilter_paeth4_sse2(recon, scanline, precon, length);
+	} else {
+		unfilter_scanline(upng, recon, scanline, precon, bytewidth, filterType, length);
+	}
+}
+#endif
+
 static void unfilter(upng_t* upng, unsigned char *out, const unsigned char *in, unsigned w, unsigned h, unsigned bpp)
 {
 	/*
@@ -766,12 +844,18 @@ static void unfilter(upng_t* upng, unsigned char *out, const unsigned char *in,
 	unsigned long bytewidth = (bpp + 7) / 8;	/*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise */
 	unsigned long linebytes = (w * bpp + 7) / 8;
 
+	void (*unfilter_line)(upng_t*, unsigned char*, const unsigned char*, const unsigned char*, unsigned long, unsigned char, unsigned long) = unfilter_scanline;
+#ifdef SIMD_X86
+	if (cpu_has_sse2())
+		unfilter_line = unfilter_scanline_sse2;
+#endif
+
 	for (y = 0; y < h; y++) {
 		unsigned long outindex = linebytes * y;
 		unsigned long inindex = (1 + linebytes) * y;	/*the extra filterbyte added to each row */
 		unsigned char filterType = in[inindex];
 
-		unfilter_scanline(upng, &out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes);
+		unfilter_line(upng, &out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes);
 		if (upng->error != UPNG_EOK) {
 			return;
 		}
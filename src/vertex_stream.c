@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "vertex_stream.h"
+
+// Make room for at least capacity vertices, keeping the current ones
+void vertex_stream_reserve(vertex_stream_t* stream, int capacity) {
+    if (capacity <= stream->capacity) return;
+
+    // Grow geometrically and round up to whole SIMD registers
+    int new_capacity = stream->capacity * 2 > capacity ? stream->capacity * 2 : capacity;
+    new_capacity = (new_capacity + VERTEX_STREAM_PADDING - 1) / VERTEX_STREAM_PADDING * VERTEX_STREAM_PADDING;
+
+    void* block = calloc(1, sizeof(float) * 3 * new_capacity + VERTEX_STREAM_ALIGNMENT);
+    float* x = (float*)(((uintptr_t)block + VERTEX_STREAM_ALIGNMENT - 1) & ~(uintptr_t)(VERTEX_STREAM_ALIGNMENT - 1));
+    float* y = x + new_capacity;
+    float* z = y + new_capacity;
+
+    // The old streams may live in memory the stream does not own, so copy based on the count
+    if (stream->count > 0) {
+        memcpy(x, stream->x, sizeof(float) * stream->count);
+        memcpy(y, stream->y, sizeof(float) * stream->count);
+        memcpy(z, stream->z, sizeof(float) * stream->count);
+    }
+    free(stream->block);
+
+    stream->x = x;
+    stream->y = y;
+    stream->z = z;
+    stream->capacity = new_capacity;
+    stream->block = block;
+}
+
+void vertex_stream_push(vertex_stream_t* stream, vec3_t v) {
+    vertex_stream_reserve(stream, stream->count + 1);
+    stream->x[stream->count] = v.x;
+    stream->y[stream->count] = v.y;
+    stream->z[stream->count] = v.z;
+    stream->count++;
+}
+
+// Replace the contents of the stream with an array of vec3_t
+void vertex_stream_from_vec3(vertex_stream_t* stream, const vec3_t* vertices, int count) {
+    vertex_stream_reserve(stream, count);
+    for (int i = 0; i < count; i++) {
+        stream->x[i] = vertices[i].x;
+        stream->y[i] = vertices[i].y;
+        stream->z[i] = vertices[i].z;
+    }
+    stream->count = count;
+}
+
+vec3_t vertex_stream_get(const vertex_stream_t* stream, int index) {
+    vec3_t v = { stream->x[index], stream->y[index], stream->z[index] };
+    return v;
+}
+
+// Axis-aligned bounding box of all the vertices in the stream
+void vertex_stream_bounds(const vertex_stream_t* stream, vec3_t* min, vec3_t* max) {
+    if (stream->count == 0) {
+        *min = vec3_new(0, 0, 0);
+        *max = vec3_new(0, 0, 0);
+        return;
+    }
+
+    // Each stream is scanned on its own as a contiguous min/max reduction
+    float streams_min[3], streams_max[3];
+    const float* streams[3] = { stream->x, stream->y, stream->z };
+    for (int s = 0; s < 3; s++) {
+        float lo = streams[s][0];
+        float hi = streams[s][0];
+        for (int i = 1; i < stream->count; i++) {
+            lo = streams[s][i] < lo ? streams[s][i] : lo;
+            hi = streams[s][i] > hi ? streams[s][i] : hi;
+        }
+        streams_min[s] = lo;
+        streams_max[s] = hi;
+    }
+    *min = vec3_new(streams_min[0], streams_min[1], streams_min[2]);
+    *max = vec3_new(streams_max[0], streams_max[1], streams_max[2]);
+}
+
+void vertex_stream_free(vertex_stream_t* stream) {
+    free(stream->block);
+    stream->x = stream->y = stream->z = NULL;
+    stream->block = NULL;
+    stream->count = 0;
+    stream->capacity = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef VERTEX_STREAM_H
+#define VERTEX_STREAM_H
+
+#include "vector.h"
+
+#define VERTEX_STREAM_ALIGNMENT 32  // bytes, the width of an AVX register
+#define VERTEX_STREAM_PADDING 8     // capacity is always a multiple of this many floats
+
+//////////////////////////////////////////////////////////////////
+// Structure-of-arrays storage for vertex positions. Each of    //
+// the x, y and z streams is aligned and padded to whole SIMD   //
+// registers, so kernels can load and store 8 values at a time  //
+// without a scalar tail. Entries past count are scratch space. //
+//////////////////////////////////////////////////////////////////
+typedef struct {
+    float* x;
+    float* y;
+    float* z;
+    int count;
+    int capacity;
+    void* block;    // single allocation holding the three streams, NULL when they point into memory owned elsewhere
+} vertex_stream_t;
+
+void vertex_stream_reserve(vertex_stream_t* stream, int capacity);
+void vertex_stream_push(vertex_stream_t* stream, vec3_t v);
+void vertex_stream_from_vec3(vertex_stream_t* stream, const vec3_t* vertices, int count);
+vec3_t vertex_stream_get(const vertex_stream_t* stream, int index);
+void vertex_stream_bounds(const vertex_stream_t* stream, vec3_t* min, vec3_t* max);
+void vertex_stream_free(vertex_stream_t* stream);
+
+#endif
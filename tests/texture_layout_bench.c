@@ -0,0 +1,143 @@
+// Compares the cache behavior of row-major texels with the 4x4 tiles of texture.c. A screen square
+// is walked in raster order and every pixel fetches the texel under it, with the texture rotated
+// and scaled. Each fetch goes through a simulated data cache, and the same walk is timed.
+
+// clock_gettime is POSIX, glibc only declares it in C99 mode when asked to
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "../src/texture.h"
+
+#define TEXTURE_SIZE 2048
+#define SCREEN_SIZE 384
+
+// 48 KB, 12-way set associative, 64-byte lines and LRU replacement, a typical L1 data cache
+#define CACHE_WAYS 12
+#define CACHE_SETS 64
+#define CACHE_LINE_BITS 6
+
+typedef struct {
+    uintptr_t lines[CACHE_SETS][CACHE_WAYS];    // every set from most to least recently used
+    long accesses;
+    long misses;
+} cache_t;
+
+static void cache_reset(cache_t* cache) {
+    memset(cache->lines, 0xFF, sizeof(cache->lines));
+    cache->accesses = 0;
+    cache->misses = 0;
+}
+
+static void cache_access(cache_t* cache, const void* address) {
+    uintptr_t line = (uintptr_t)address >> CACHE_LINE_BITS;
+    uintptr_t* set = cache->lines[line % CACHE_SETS];
+    int way = 0;
+    while (way < CACHE_WAYS && set[way] != line) way++;
+    cache->accesses++;
+    if (way == CACHE_WAYS) {
+        cache->misses++;
+        way = CACHE_WAYS - 1;
+    }
+    memmove(set + 1, set, sizeof(uintptr_t) * way);
+    set[0] = line;
+}
+
+static double now_seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Texel coordinates under the pixels of the screen square, the ones that fall outside the texture are skipped
+static int walk_texture(int (*coords)[2], float angle_degrees, float texels_per_pixel) {
+    float angle = angle_degrees * 3.14159265f / 180;
+    float c = cosf(angle) * texels_per_pixel;
+    float s = sinf(angle) * texels_per_pixel;
+    int count = 0;
+    for (int y = 0; y < SCREEN_SIZE; y++) {
+        for (int x = 0; x < SCREEN_SIZE; x++) {
+            float dx = x - SCREEN_SIZE / 2.0f;
+            float dy = y - SCREEN_SIZE / 2.0f;
+            int u = (int)(TEXTURE_SIZE / 2 + c * dx - s * dy);
+            int v = (int)(TEXTURE_SIZE / 2 + s * dx + c * dy);
+            if (u < 0 || v < 0 || u >= TEXTURE_SIZE || v >= TEXTURE_SIZE) continue;
+            coords[count][0] = u;
+            coords[count][1] = v;
+            count++;
+        }
+    }
+    return count;
+}
+
+int main(void) {
+    static int coords[SCREEN_SIZE * SCREEN_SIZE][2];
+    static cache_t cache;
+    uint32_t* row_major = (uint32_t*)malloc(sizeof(uint32_t) * TEXTURE_SIZE * TEXTURE_SIZE);
+    texture_t texture;
+    if (row_major == NULL) {
+        fprintf(stderr, "Error allocating the texture.\n");
+        return 1;
+    }
+    srand(1);
+    for (int i = 0; i < TEXTURE_SIZE * TEXTURE_SIZE; i++) {
+        row_major[i] = (uint32_t)rand();
+    }
+    if (!create_texture(&texture, row_major, TEXTURE_SIZE, TEXTURE_SIZE)) {
+        free(row_major);
+        return 1;
+    }
+    const texture_level_t* level = &texture.levels[0];
+
+    float scales[] = { 1, 2 };
+    float angles[] = { 0, 30, 45, 90 };
+    printf("%dx%d texture, %dx%d screen walk, %d KB %d-way LRU cache\n",
+        TEXTURE_SIZE, TEXTURE_SIZE, SCREEN_SIZE, SCREEN_SIZE, CACHE_SETS * CACHE_WAYS * (1 << CACHE_LINE_BITS) / 1024, CACHE_WAYS);
+    printf("scale  angle  row-major miss  tiled miss  row-major ns/fetch  tiled ns/fetch\n");
+    for (int i = 0; i < 2; i++) {
+        for (int k = 0; k < 4; k++) {
+            int count = walk_texture(coords, angles[k], scales[i]);
+
+            cache_reset(&cache);
+            for (int j = 0; j < count; j++) {
+                cache_access(&cache, &row_major[coords[j][1] * TEXTURE_SIZE + coords[j][0]]);
+            }
+            double row_major_miss = 100.0 * cache.misses / cache.accesses;
+            cache_reset(&cache);
+            for (int j = 0; j < count; j++) {
+                cache_access(&cache, &level->texels[TEXEL_INDEX(level, coords[j][0], coords[j][1])]);
+            }
+            double tiled_miss = 100.0 * cache.misses / cache.accesses;
+
+            // Best of five runs of the real fetches, the sum keeps them from being optimized away
+            double row_major_time = 1e9;
+            double tiled_time = 1e9;
+            volatile uint32_t sink = 0;
+            for (int run = 0; run < 5; run++) {
+                uint32_t sum = 0;
+                double start = now_seconds();
+                for (int j = 0; j < count; j++) {
+                    sum += row_major[coords[j][1] * TEXTURE_SIZE + coords[j][0]];
+                }
+                double time = now_seconds() - start;
+                if (time < row_major_time) row_major_time = time;
+
+                start = now_seconds();
+                for (int j = 0; j < count; j++) {
+                    sum += level->texels[TEXEL_INDEX(level, coords[j][0], coords[j][1])];
+                }
+                time = now_seconds() - start;
+                if (time < tiled_time) tiled_time = time;
+                sink += sum;
+            }
+            printf("%5.0f  %5.0f  %13.1f%%  %9.1f%%  %18.2f  %14.2f\n", scales[i], angles[k], row_major_miss, tiled_miss,
+                row_major_time * 1e9 / count, tiled_time * 1e9 / count);
+        }
+    }
+
+    free_texture(&texture);
+    free(row_major);
+    return 0;
+}
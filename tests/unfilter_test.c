@@ -0,0 +1,99 @@
+// Checks that the SSE2 PNG unfilter kernels give the same bytes as the scalar code.
+// upng.c is compiled into this file so the test reaches its static functions, and its
+// CPU check is routed through use_sse2 so every PNG can be decoded both ways.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool use_sse2 = false;
+#define cpu_has_sse2 test_cpu_has_sse2
+#include "../src/upng.c"
+
+bool test_cpu_has_sse2(void) {
+    return use_sse2;
+}
+
+// Decoded pixels of a PNG file, or NULL when it does not decode
+static unsigned char* decode_png(const char* filename, unsigned* size) {
+    upng_t* png = upng_new_from_file(filename);
+    if (png == NULL) return NULL;
+    unsigned char* pixels = NULL;
+    if (upng_decode(png) == UPNG_EOK) {
+        *size = upng_get_size(png);
+        pixels = malloc(*size);
+        if (pixels != NULL) memcpy(pixels, upng_get_buffer(png), *size);
+    } else {
+        fprintf(stderr, "Error decoding %s, upng error %d at line %u.\n", filename, upng_get_error(png), upng_get_error_line(png));
+    }
+    upng_free(png);
+    return pixels;
+}
+
+static bool test_png(const char* filename) {
+    unsigned scalar_size = 0;
+    unsigned sse2_size = 0;
+    use_sse2 = false;
+    unsigned char* scalar = decode_png(filename, &scalar_size);
+    use_sse2 = true;
+    unsigned char* sse2 = decode_png(filename, &sse2_size);
+
+    bool is_equal = scalar != NULL && sse2 != NULL && scalar_size == sse2_size && memcmp(scalar, sse2, scalar_size) == 0;
+    if (scalar != NULL && sse2 != NULL && !is_equal) {
+        fprintf(stderr, "Error: %s decodes differently with the SSE2 and the scalar unfilter.\n", filename);
+    }
+    free(scalar);
+    free(sse2);
+    return is_equal;
+}
+
+#ifdef SIMD_X86
+// Random scanlines through every filter, pixel size and prior row, also unfiltered in place
+static bool test_random_scanlines(void) {
+    static unsigned char precon[1024], scanline[1024], scalar[1024], sse2[1024], in_place[1024];
+    upng_t png;
+    memset(&png, 0, sizeof(png));
+    srand(1);
+    for (int i = 0; i < 20000; i++) {
+        unsigned long bytewidth = 1 + rand() % 8;
+        unsigned long length = bytewidth * (1 + rand() % (sizeof(scanline) / 8));
+        unsigned char filter_type = 1 + rand() % 4;
+        for (unsigned long k = 0; k < length; k++) {
+            precon[k] = (unsigned char)rand();
+            scanline[k] = (unsigned char)rand();
+        }
+        const unsigned char* prior_row = i % 8 == 0 ? NULL : precon;
+
+        unfilter_scanline(&png, scalar, scanline, prior_row, bytewidth, filter_type, length);
+        unfilter_scanline_sse2(&png, sse2, scanline, prior_row, bytewidth, filter_type, length);
+        memcpy(in_place, scanline, length);
+        unfilter_scanline_sse2(&png, in_place, in_place, prior_row, bytewidth, filter_type, length);
+        if (memcmp(scalar, sse2, length) != 0 || memcmp(scalar, in_place, length) != 0) {
+            fprintf(stderr, "Error: filter %d with %lu byte pixels unfilters differently with SSE2.\n", filter_type, bytewidth);
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+#ifdef SIMD_X86
+    if (!__builtin_cpu_supports("sse2")) {
+        printf("Skipped, this CPU has no SSE2.\n");
+        return 0;
+    }
+    int failures = test_random_scanlines() ? 0 : 1;
+    for (int i = 1; i < argc; i++) {
+        if (!test_png(argv[i])) failures++;
+    }
+    printf("%d PNG files and 20000 random scanlines checked, %d failed.\n", argc - 1, failures);
+    return failures == 0 ? 0 : 1;
+#else
+    (void)argc;
+    (void)argv;
+    (void)test_png;
+    printf("Skipped, there is no SSE2 unfilter on this CPU.\n");
+    return 0;
+#endif
+}
@@ -0,0 +1,31 @@
+// Reports how well the load-time face reordering uses the post-transform vertex cache.
+// src/mesh.c is compiled into this file so the benchmark runs the same build_mesh_lods
+// as the loader. The OBJ is parsed directly, a mesh cache would hold the reordered faces.
+#include <stdio.h>
+#include "../src/mesh.c"
+
+int main(int argc, char* argv[]) {
+    int failures = 0;
+    for (int i = 1; i < argc; i++) {
+        obj_data_t obj;
+        if (!obj_load(argv[i], &obj)) {
+            failures++;
+            continue;
+        }
+        mesh_t mesh = { 0 };
+        mesh.vertices = obj.vertices;
+        mesh.texcoords = obj.texcoords;
+        mesh.lods[0].faces = obj.faces;
+
+        // Transformed vertices per face with a VERTEX_CACHE_SIZE entry FIFO, lower is better
+        int num_vertices = array_length(mesh.vertices);
+        int num_faces = array_length(mesh.lods[0].faces);
+        float acmr_before = average_cache_miss_ratio(mesh.lods[0].faces, num_faces, num_vertices);
+        build_mesh_lods(&mesh);
+        float acmr_after = average_cache_miss_ratio(mesh.lods[0].faces, num_faces, num_vertices);
+        printf("%s: %d faces, ACMR %.3f before and %.3f after reordering the faces.\n", argv[i], num_faces, acmr_before, acmr_after);
+
+        free_mesh(&mesh);
+    }
+    return failures == 0 ? 0 : 1;
+}